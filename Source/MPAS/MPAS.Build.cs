@@ -40,6 +40,8 @@ public class MPAS : ModuleRules
 				"Engine",
 				"Slate",
 				"SlateCore",
+				"Landscape",
+				"NavigationSystem",
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);
@@ -6,19 +6,24 @@
 #include "MPAS_RigElement.h"
 #include "Default/RigElements/MPAS_Leg.h"
 #include "Default/RigElements/MPAS_BodySegment.h"
-#include "Kismet/KismetMathLibrary.h"
 
 // Called when the state is made active
 void UMPAS_LegIntentionDriverState::EnterState_Implementation()
 {
-	LegsData.Empty();
-	TargetLayers.Empty();
+	Bodies.Empty();
+	BodyLegOffsets.Empty();
+	BodyLegCounts.Empty();
+	Legs.Empty();
+	LegTargetLayers.Empty();
+	LegEffectorShiftLayers.Empty();
 
 	// Scanning the rig to find legs and their parent body segments
 	// This intention driver will only control leg's that are attached to body segments (ignoring visual elements like limbs)
+	TMap<UMPAS_BodySegment*, TArray<UMPAS_Leg*>> LegsData;
+
 	for (auto& RigElementDataPair : GetHandler()->GetRigData())
 	{
-		FMPAS_RigElementData RigElementData = RigElementDataPair.Value;
+		const FMPAS_RigElementData& RigElementData = RigElementDataPair.Value;
 
 		// Ignore elements that are directly attached to the core
 		if (RigElementData.ParentComponent == "Core") continue;
@@ -27,14 +32,36 @@ void UMPAS_LegIntentionDriverState::EnterState_Implementation()
 		auto ParentBody = Cast<UMPAS_BodySegment>(GetHandler()->GetRigData()[RigElementData.ParentComponent].RigElement);
 
 		if (Leg && ParentBody)
-		{
-			if (LegsData.Contains(ParentBody)) LegsData[ParentBody].Add(Leg);
-			else LegsData.Add(ParentBody, TArray<UMPAS_Leg*> { Leg });
+			LegsData.FindOrAdd(ParentBody).Add(Leg);
+	}
+
+	// Compiling flat per body data, so that updates don't have to look anything up
+	int32 MaxLegsPerBody = 0;
+
+	for (auto& BodyLegs : LegsData)
+	{
+		Bodies.Add(BodyLegs.Key);
+		BodyLegOffsets.Add(Legs.Num());
+		BodyLegCounts.Add(BodyLegs.Value.Num());
+
+		MaxLegsPerBody = FMath::Max(MaxLegsPerBody, BodyLegs.Value.Num());
 
-			TargetLayers.Add(Leg, Leg->RegisterVectorLayer(Leg->GetTargetLocationStackID(), "IntentionDrivenLegTarget", EMPAS_LayerBlendingMode::Normal, EMPAS_LayerCombinationMode::Add, 1.f, 1, true));
-			EffectorShiftLayers.Add(Leg, Leg->RegisterVectorLayer(Leg->GetEffectorShiftStackID(), "IntentionDrivenEffectorShift", EMPAS_LayerBlendingMode::Normal, EMPAS_LayerCombinationMode::Add, 1.f, 1, true));
+		for (UMPAS_Leg* Leg : BodyLegs.Value)
+		{
+			Legs.Add(Leg);
+			LegTargetLayers.Add(Leg->RegisterVectorLayer(Leg->GetTargetLocationStackID(), "IntentionDrivenLegTarget", EMPAS_LayerBlendingMode::Normal, EMPAS_LayerCombinationMode::Add, 1.f, 1, true));
+			LegEffectorShiftLayers.Add(Leg->RegisterVectorLayer(Leg->GetEffectorShiftStackID(), "IntentionDrivenEffectorShift", EMPAS_LayerBlendingMode::Normal, EMPAS_LayerCombinationMode::Add, 1.f, 1, true));
 		}
 	}
+
+	// Preallocating scratch buffers
+	ActiveLegIndices.Reset(MaxLegsPerBody);
+	ShiftLimitations.Reset(MaxLegsPerBody);
+	Shift.Reset(MaxLegsPerBody);
+
+	ShiftLocalLimitMin.Reset(MaxLegsPerBody);
+	ShiftLocalLimitMax.Reset(MaxLegsPerBody);
+	ShiftBreakpoints.Reset(MaxLegsPerBody * 2);
 }
 
 
@@ -47,26 +74,26 @@ void UMPAS_LegIntentionDriverState::UpdateState_Implementation(float DeltaTime)
 {
 	// Calculating target locations and offsets for all of the legs, based on the desired transform of the corresponding body segment
 
-	for (auto& BodyLegs : LegsData)
+	for (int32 BodyIndex = 0; BodyIndex < Bodies.Num(); BodyIndex++)
 	{
-		UMPAS_BodySegment* Body = BodyLegs.Key;
+		UMPAS_BodySegment* Body = Bodies[BodyIndex];
 
-		// Fetching desired transform from the body segment
+		// Fetching desired location from the body segment
 		FVector DesiredLocation = Body->GetDesiredLocation();
-		FRotator DesiredRotation = Body->GetDesiredRotation();
 
 		// Initial Leg Placement + Average location calculation
-		int32 NumberOfLegs = 0;
 		FVector LegAverageLocation = FVector(0);
-		TArray<UMPAS_Leg*> ActiveLegs;
 
-		// Horizontal Shift limitations for each active leg <Min, Max>
-		TArray<TPair<FVector, FVector>> ShiftLimitations;
+		ActiveLegIndices.Reset();
+		ShiftLimitations.Reset();
 
-		for (auto& Leg : BodyLegs.Value)
+		const int32 LegsEnd = BodyLegOffsets[BodyIndex] + BodyLegCounts[BodyIndex];
+		for (int32 LegIndex = BodyLegOffsets[BodyIndex]; LegIndex < LegsEnd; LegIndex++)
 		{
-			FVector TraceLocation = DesiredRotation.RotateVector(Leg->GetLegTargetOffset()) + DesiredLocation;
-			FVector PlacementLocation = PlaceLegTargetLocation(Leg->FootTrace(TraceLocation));
+			UMPAS_Leg* Leg = Legs[LegIndex];
+
+			// Basic target is calculated by the leg once per update
+			FVector PlacementLocation = PlaceLegTargetLocation(Leg->FootTrace(Leg->GetBasicTargetLocation()));
 
 			// If we failed to place the leg, we deactivate it and continue to the next leg
 			if (PlacementLocation == FVector(0)) { Leg->SetActive(false); continue; }
@@ -74,36 +101,41 @@ void UMPAS_LegIntentionDriverState::UpdateState_Implementation(float DeltaTime)
 			// If leg's placement was succesful we fetch it's data and mark it as an active leg
 
 			// Setting leg's target location
-			Leg->SetVectorSourceValue(Leg->GetTargetLocationStackID(), TargetLayers[Leg], Leg, PlacementLocation);
+			Leg->SetVectorSourceValue(Leg->GetTargetLocationStackID(), LegTargetLayers[LegIndex], Leg, PlacementLocation);
 
 			// Marking leg as active
-			ActiveLegs.Add(Leg);
+			ActiveLegIndices.Add(LegIndex);
 
 			// Average calculation steps
-			NumberOfLegs++;
 			LegAverageLocation += Leg->GetComponentLocation();
 
-			// Fetching limitations
+			// Fetching limitations (read every update, as they can be changed at runtime)
 			ShiftLimitations.Add(TPair<FVector, FVector>(Leg->EffectorShift_Min, Leg->EffectorShift_Max));
 		}
 
+		const int32 NumberOfLegs = ActiveLegIndices.Num();
+		if (NumberOfLegs == 0) continue;
+
 		// Completing average calculation
 		LegAverageLocation /= NumberOfLegs;
 
 		// Calculating each leg's effector shift
 
 		// Initializing shift array
-		TArray<FVector> Shift;
-		Shift.Init(FVector(0), NumberOfLegs);
+		Shift.Reset();
+		Shift.AddZeroed(NumberOfLegs);
 
 		// Calculating target value
 		FVector Target = DesiredLocation - LegAverageLocation;
 
 		CalculateEffectorShift(Shift, Target, ShiftLimitations, Body->GetComponentQuat());
 
-		// Setting leg shift with interpolation
-		for (int i = 0; i < ActiveLegs.Num(); i++)
-			ActiveLegs[i]->SetVectorSourceValue(ActiveLegs[i]->GetEffectorShiftStackID(), EffectorShiftLayers[ActiveLegs[i]], ActiveLegs[i], Shift[i]);
+		// Setting leg shift
+		for (int32 i = 0; i < NumberOfLegs; i++)
+		{
+			UMPAS_Leg* Leg = Legs[ActiveLegIndices[i]];
+			Leg->SetVectorSourceValue(Leg->GetEffectorShiftStackID(), LegEffectorShiftLayers[ActiveLegIndices[i]], Leg, Shift[i]);
+		}
 	}
 }
 
@@ -124,63 +156,76 @@ FVector UMPAS_LegIntentionDriverState::PlaceLegTargetLocation(const FVector& Des
 */
 void UMPAS_LegIntentionDriverState::CalculateEffectorShift(TArray<FVector>& OutShift, const FVector& InTarget, const TArray<TPair<FVector, FVector>>& InLimitations, const FQuat& LimitSpaceRotation)
 {
-	// Assigning target shift value to each leg
-	for (int i = 0; i < OutShift.Num(); i++) OutShift[i] = InTarget;
+	const int32 NumberOfLegs = OutShift.Num();
+	if (NumberOfLegs == 0) return;
 
-	// Initializing clamp cache (stores whether each leg was clamped with most recent clamp call)
-	TArray<bool> ClampCache;
-	ClampCache.Init(false, OutShift.Num());
+	// Limits are axis aligned in limit space, so each axis is distributed independently
+	ShiftLocalLimitMin.Reset();
+	ShiftLocalLimitMax.Reset();
 
-	// Initial clamp
-	ClampShift(OutShift, ClampCache, InLimitations, LimitSpaceRotation);
-
-	// Redistribution iterations
-	for (int i = 1; i < OutShift.Num(); i++)
+	for (int32 i = 0; i < NumberOfLegs; i++)
 	{
-		ShiftRedistributionIteration(OutShift, InTarget, ClampCache);
-		ClampShift(OutShift, ClampCache, InLimitations, LimitSpaceRotation);
+		ShiftLocalLimitMin.Add(InLimitations[i].Key.ComponentMin(InLimitations[i].Value));
+		ShiftLocalLimitMax.Add(InLimitations[i].Key.ComponentMax(InLimitations[i].Value));
 	}
+
+	const FVector LocalTarget = LimitSpaceRotation.UnrotateVector(InTarget);
+
+	for (int32 Axis = 0; Axis < 3; Axis++)
+		DistributeShiftAxis(OutShift, Axis, LocalTarget[Axis]);
+
+	// Back to world space
+	for (FVector& Shift : OutShift)
+		Shift = LimitSpaceRotation.RotateVector(Shift);
 }
 
 /*
-* Clamps effector shift to it's limitations
-* OutClamped contains data, whether each individual offset was clamped
+* Distributes a single axis of the target shift (in limit space) between the legs: finds the level, that clamped to every leg's limits sums up to InTarget * number of legs
+* Writes the result into the InAxis component of InOutLocalShift
 */
-void UMPAS_LegIntentionDriverState::ClampShift(TArray<FVector>& InOutShift, TArray<bool>& OutClamped, const TArray<TPair<FVector, FVector>>& InLimitations, const FQuat& LimitSpaceRotation)
+void UMPAS_LegIntentionDriverState::DistributeShiftAxis(TArray<FVector>& InOutLocalShift, int32 InAxis, float InTarget)
 {
-	for (int i = 0; i < InOutShift.Num(); i++)
-	{
-		FVector PreviousShift = InOutShift[i];
+	const int32 NumberOfLegs = InOutLocalShift.Num();
 
-		FVector LocalizedShift = UKismetMathLibrary::Quat_UnrotateVector(LimitSpaceRotation, InOutShift[i]);
-		FVector LimitedLocalizedShift = ClampVector(LocalizedShift, InLimitations[i].Key, InLimitations[i].Value);
+	// Sum of the clamped shifts is a piecewise linear function of the level, it's slope changes at the limits of the legs:
+	// +1 when the level passes leg's min, -1 when it passes leg's max
+	ShiftBreakpoints.Reset();
 
-		InOutShift[i] = LimitSpaceRotation.RotateVector(LimitedLocalizedShift);
+	float Sum = 0.f;
+	for (int32 i = 0; i < NumberOfLegs; i++)
+	{
+		ShiftBreakpoints.Add(TPair<float, int32>(ShiftLocalLimitMin[i][InAxis], 1));
+		ShiftBreakpoints.Add(TPair<float, int32>(ShiftLocalLimitMax[i][InAxis], -1));
 
-		OutClamped[i] = !UKismetMathLibrary::EqualEqual_VectorVector(InOutShift[i], PreviousShift);
+		// Sum at the lowest level, where every leg is at it's min
+		Sum += ShiftLocalLimitMin[i][InAxis];
 	}
-}
 
-/*
-* Redistributes shift from leg's that hit there limitation to the ones that are still capable of moving
-* Updates the values in the InOutShift
-*/
-void UMPAS_LegIntentionDriverState::ShiftRedistributionIteration(TArray<FVector>& InOutShift, const FVector& InTarget, const TArray<bool>& InClamped)
-{
-	for (int i = 0; i < InOutShift.Num(); i++)
-	{
-		// Do not change clamped values
-		if (InClamped[i]) continue;
+	ShiftBreakpoints.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B) { return A.Key < B.Key; });
+
+	// Walking the segments until the required sum is reached (if it can't be reached, the level stops at the last breakpoint and all legs stay at their max)
+	const float TargetSum = InTarget * NumberOfLegs;
 
-		int NumberOfNonClamped = 0;
-		FVector Sum = FVector(0);
+	float Level = ShiftBreakpoints[0].Key;
+	int32 Slope = 0;
 
-		for (int j = 0; j < InOutShift.Num(); j++)
+	for (const TPair<float, int32>& Breakpoint : ShiftBreakpoints)
+	{
+		const float NextSum = Sum + Slope * (Breakpoint.Key - Level);
+
+		if (Slope > 0 && NextSum >= TargetSum)
 		{
-			NumberOfNonClamped += (int)(!InClamped[j]);
-			Sum += InTarget - InOutShift[j];
+			Level += (TargetSum - Sum) / Slope;
+			break;
 		}
 
-		InOutShift[i] += (Sum / NumberOfNonClamped);
+		if (Sum >= TargetSum) break;
+
+		Sum = NextSum;
+		Level = Breakpoint.Key;
+		Slope += Breakpoint.Value;
 	}
+
+	for (int32 i = 0; i < NumberOfLegs; i++)
+		InOutLocalShift[i][InAxis] = FMath::Clamp(Level, ShiftLocalLimitMin[i][InAxis], ShiftLocalLimitMax[i][InAxis]);
 }
@@ -73,6 +73,26 @@ void UMPAS_BodySegment::UpdateRigElement(float DeltaTime)
     CachedDesiredLocation = CalculateVectorStackValue(DesiredLocationStackID);
     CachedDesiredRotation = CalculateRotationStackValue(DesiredRotationStackID);
 
+    // Measuring desired velocities (used by legs to predict, where the body will be)
+    const FQuat DesiredQuat = CachedDesiredRotation.Quaternion();
+
+    if (HasPreviousDesiredTransform && DeltaTime > 0.f)
+    {
+        FQuat DeltaRotation = DesiredQuat * PreviousDesiredRotation.Inverse();
+        DeltaRotation.EnforceShortestArcWith(FQuat::Identity);
+
+        FVector Axis;
+        float Angle;
+        DeltaRotation.ToAxisAndAngle(Axis, Angle);
+
+        DesiredVelocity = UKismetMathLibrary::VInterpTo(DesiredVelocity, (CachedDesiredLocation - PreviousDesiredLocation) / DeltaTime, DeltaTime, DesiredVelocitySmoothingSpeed);
+        DesiredAngularVelocity = UKismetMathLibrary::VInterpTo(DesiredAngularVelocity, Axis * Angle / DeltaTime, DeltaTime, DesiredVelocitySmoothingSpeed);
+    }
+
+    PreviousDesiredLocation = CachedDesiredLocation;
+    PreviousDesiredRotation = DesiredQuat;
+    HasPreviousDesiredTransform = true;
+
     // Updating enforcement
     //FVector EnforcementVector = UKismetMathLibrary::VInterpTo(GetComponentLocation(), CachedDesiredLocation, DeltaTime, DesiredPositionEnforcement) - GetComponentLocation();
     
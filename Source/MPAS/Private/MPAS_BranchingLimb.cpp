@@ -0,0 +1,468 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Default/RigElements/MPAS_BranchingLimb.h"
+#include "MPAS_Handler.h"
+#include "Engine/SkeletalMesh.h"
+#include "Kismet/KismetStringLibrary.h"
+
+// Constructor
+UMPAS_BranchingLimb::UMPAS_BranchingLimb() {}
+
+
+// Initializes branches, layout and state
+void UMPAS_BranchingLimb::InitLimb()
+{
+    Initialized = false;
+
+    TArray<TArray<FMPAS_LimbSegmentState>> L_FetchedStates;
+
+    if (SetupType == EMPAS_LimbSetupType::FetchFromMesh && !FetchBranchesFromMesh(L_FetchedStates))
+        return;
+
+    BuildLayout();
+
+    // Replacing default state with the fetched one
+    if (SetupType == EMPAS_LimbSetupType::FetchFromMesh)
+    {
+        for (int32 b = 0; b < L_FetchedStates.Num(); b++)
+            for (int32 i = 0; i < L_FetchedStates[b].Num(); i++)
+                CurrentState[Layout.Offsets[b] + i] = L_FetchedStates[b][i];
+
+        // Fetching origin position if needed
+        if (Fetch_OriginPosition && Layout.StateNum > 0)
+        {
+            bool HasActiveElements = false;
+            FVector ParentLocation = CalculateVectorLayerValue(VectorStacks[0][0], HasActiveElements);
+            FVector NewSelfLocation = CurrentState[0].Location - ParentLocation;
+
+            SetVectorSourceValue(0, 1, this, NewSelfLocation);
+        }
+    }
+
+    // Caching swing-twist limit values for the solver
+    for (FMPAS_LimbSegmentData& Segment : Layout.Segments)
+        Segment.CacheSwingTwistLimits();
+
+    // Limb's segments mirror the layout, so the states are written and interpolated by the limb
+    Segments = Layout.Segments;
+
+    // Targets are clamped by the extents of their branches, the limb as a whole reaches as far as it's longest branch
+    MaxExtent = 0.f;
+    for (float BranchMaxExtent : BranchMaxExtents)
+        MaxExtent = FMath::Max(MaxExtent, BranchMaxExtent);
+
+    TargetState = CurrentState;
+    HasCachedSolution = false;
+
+    AssignBranchTargets();
+
+    Initialized = Layout.StateNum > 0;
+}
+
+// Fetches segments of all branches from the skeletal mesh (and their current states), returns false if the mesh is not found
+bool UMPAS_BranchingLimb::FetchBranchesFromMesh(TArray<TArray<FMPAS_LimbSegmentState>>& OutBranchStates)
+{
+    // Attempts to find Fetch mesh if it is not already set. Will grab the first skeletal mesh component with tag "MPAS_LimbFetch"
+    if (!Fetch_MeshComponent)
+    {
+        TArray<UActorComponent*> Components = GetOwner()->GetComponentsByTag(USkeletalMeshComponent::StaticClass(), "MPAS_LimbFetch");
+        if (Components.Num() > 0)
+            Fetch_MeshComponent = Cast<USkeletalMeshComponent>(Components[0]);
+    }
+
+    if (!Fetch_MeshComponent)
+        return false;
+
+    OutBranchStates.SetNum(Branches.Num());
+
+    // Bones, that are already driven by one of the branches (the junction bone is driven by the first branch, that starts at it)
+    TSet<FName> L_ClaimedBones;
+
+    for (int32 b = 0; b < Branches.Num(); b++)
+    {
+        FMPAS_LimbBranch& Branch = Branches[b];
+        const bool L_HasParent = Branch.ParentBranch >= 0 && Branch.ParentBranch < b;
+        const FName L_OriginBone = L_HasParent ? Branches[Branch.ParentBranch].Fetch_TipBone : Fetch_OriginBone;
+
+        // Fetching the bone chain (in reverse order, because you can only get bone's parent and not children)
+        TArray<FName> ReversedBoneChain;
+
+        FName Bone = Branch.Fetch_TipBone;
+        while (Fetch_MeshComponent->GetBoneIndex(Bone) != INDEX_NONE)
+        {
+            ReversedBoneChain.Add(Bone);
+
+            if (Bone == L_OriginBone)
+                break;
+
+            Bone = Fetch_MeshComponent->GetParentBone(Bone);
+        }
+
+        // Origin bone was not reached, the branch is left empty
+        if (ReversedBoneChain.Num() == 0 || ReversedBoneChain.Last() != L_OriginBone)
+            ReversedBoneChain.Reset();
+
+        // Keeping user-defined segment data (limits, mesh extent), only bone names and lengths are fetched
+        TArray<FMPAS_LimbSegmentData> L_OldSegments = Branch.Segments;
+        Branch.Segments.Reset();
+
+        for (int32 i = ReversedBoneChain.Num() - 1; i > 0; i--)
+        {
+            const int32 L_SegmentIndex = Branch.Segments.Num();
+
+            FMPAS_LimbSegmentData NewSegment = L_OldSegments.IsValidIndex(L_SegmentIndex) ? L_OldSegments[L_SegmentIndex] : FMPAS_LimbSegmentData();
+            FMPAS_LimbSegmentState NewState;
+
+            NewState.Location = Fetch_MeshComponent->GetBoneLocation(ReversedBoneChain[i]);
+            NewState.Rotation = (FRotator)Fetch_MeshComponent->GetBoneQuaternion(ReversedBoneChain[i]);
+
+            NewSegment.BoneName = L_ClaimedBones.Contains(ReversedBoneChain[i]) ? FName() : ReversedBoneChain[i];
+            NewSegment.Length = (NewState.Location - Fetch_MeshComponent->GetBoneLocation(ReversedBoneChain[i - 1])).Size();
+
+            L_ClaimedBones.Add(ReversedBoneChain[i]);
+
+            Branch.Segments.Add(NewSegment);
+            OutBranchStates[b].Add(NewState);
+        }
+
+        // Tip bone state
+        FMPAS_LimbSegmentState TipBoneState;
+
+        if (ReversedBoneChain.Num() > 0)
+        {
+            TipBoneState.Location = Fetch_MeshComponent->GetBoneLocation(ReversedBoneChain[0]);
+            TipBoneState.Rotation = (FRotator)Fetch_MeshComponent->GetBoneQuaternion(ReversedBoneChain[0]);
+        }
+
+        OutBranchStates[b].Add(TipBoneState);
+    }
+
+    return true;
+}
+
+// Builds the flattened layout and the initial (straight up) state from Branches
+void UMPAS_BranchingLimb::BuildLayout()
+{
+    const int32 L_BranchNum = Branches.Num();
+
+    Layout.Offsets.SetNum(L_BranchNum);
+    Layout.SegmentCounts.SetNum(L_BranchNum);
+    Layout.Parents.SetNum(L_BranchNum);
+    Layout.Weights.SetNum(L_BranchNum);
+    Layout.IsEndBranch.Init(true, L_BranchNum);
+    Layout.Segments.Reset();
+    Layout.StateNum = 0;
+
+    BranchMaxExtents.SetNum(L_BranchNum);
+    CurrentState.Reset();
+    StateParents.Reset();
+
+    for (int32 b = 0; b < L_BranchNum; b++)
+    {
+        const FMPAS_LimbBranch& Branch = Branches[b];
+
+        // Parents must come before their children, invalid parents are treated as the origin of the limb
+        const int32 L_Parent = (Branch.ParentBranch >= 0 && Branch.ParentBranch < b) ? Branch.ParentBranch : -1;
+
+        Layout.Offsets[b] = Layout.StateNum;
+        Layout.SegmentCounts[b] = Branch.Segments.Num();
+        Layout.Parents[b] = L_Parent;
+        Layout.Weights[b] = FMath::Max(Branch.Weight, KINDA_SMALL_NUMBER);
+
+        if (L_Parent >= 0)
+            Layout.IsEndBranch[L_Parent] = false;
+
+        // Initial state, segments are stacked straight up, starting at the tip of the parent branch
+        FVector L_Location = (L_Parent >= 0) ? CurrentState[Layout.Offsets[L_Parent] + Layout.SegmentCounts[L_Parent]].Location : GetComponentLocation();
+        float L_Extent = (L_Parent >= 0) ? BranchMaxExtents[L_Parent] : 0.f;
+
+        for (int32 i = 0; i <= Branch.Segments.Num(); i++)
+        {
+            FMPAS_LimbSegmentState NewState;
+            NewState.Location = L_Location;
+            NewState.Rotation = FVector::UpVector.Rotation();
+
+            CurrentState.Add(NewState);
+
+            // The first state of the branch starts at the tip of the parent branch (tip segments have zero length)
+            if (i > 0)
+                StateParents.Add(Layout.StateNum + i - 1);
+            else
+                StateParents.Add((L_Parent >= 0) ? Layout.Offsets[L_Parent] + Layout.SegmentCounts[L_Parent] : -1);
+
+            // Fective segment data at the tip of the branch
+            if (i == Branch.Segments.Num())
+            {
+                Layout.Segments.Add(FMPAS_LimbSegmentData());
+                break;
+            }
+
+            Layout.Segments.Add(Branch.Segments[i]);
+
+            L_Location += FVector::UpVector * Branch.Segments[i].Length;
+            L_Extent += Branch.Segments[i].Length;
+        }
+
+        BranchMaxExtents[b] = L_Extent;
+        Layout.StateNum += Branch.Segments.Num() + 1;
+    }
+}
+
+// Assigns child elements or target vector stacks to the end branches
+void UMPAS_BranchingLimb::AssignBranchTargets()
+{
+    TargetComponents.Reset();
+    TargetStackIDs.Reset();
+
+    int32 L_EndBranchIndex = 0;
+
+    for (int32 b = 0; b < Layout.IsEndBranch.Num(); b++)
+    {
+        if (!Layout.IsEndBranch[b])
+            continue;
+
+        if (TargetType == EMPAS_LimbTargetType::FirstChildComponent)
+        {
+            if (ChildTargetElements.IsValidIndex(L_EndBranchIndex))
+                TargetComponents.Add(b, ChildTargetElements[L_EndBranchIndex]);
+        }
+
+        else if (TargetType == EMPAS_LimbTargetType::TargetVectorStack)
+            TargetStackIDs.Add(b, RegisterVectorStack("BranchTarget_" + UKismetStringLibrary::Conv_IntToString(b)));
+
+        L_EndBranchIndex++;
+    }
+}
+
+// Returns the ID of the target vector stack of the given end branch, used if TargetType is set to TargetVectorStack ( -1 if the branch has no stack)
+int32 UMPAS_BranchingLimb::GetBranchTargetStackID(int32 InBranch)
+{
+    const int32* StackID = TargetStackIDs.Find(InBranch);
+    return StackID ? *StackID : -1;
+}
+
+// The point in space (World Space), which the given end branch is trying to reach
+FVector UMPAS_BranchingLimb::GetBranchTarget(int32 InBranch)
+{
+    const FVector Origin = GetComponentLocation();
+    FVector Target = Origin;
+
+    switch (TargetType)
+    {
+
+    case EMPAS_LimbTargetType::FirstChildComponent:
+        if (USceneComponent** TargetComponent = TargetComponents.Find(InBranch))
+            Target = (*TargetComponent)->GetComponentLocation();
+        break;
+
+    case EMPAS_LimbTargetType::TargetVectorStack:
+        if (const int32* StackID = TargetStackIDs.Find(InBranch))
+            Target = CalculateVectorStackValue(*StackID);
+        break;
+
+    default: break;
+    }
+
+    // Limit target to branch's max extent range
+    if (BranchMaxExtents.IsValidIndex(InBranch))
+    {
+        const float L_MaxExtent = BranchMaxExtents[InBranch];
+        if ((Target - Origin).SizeSquared() > L_MaxExtent * L_MaxExtent)
+            Target = Origin + (Target - Origin).GetSafeNormal() * L_MaxExtent;
+    }
+
+    return Target;
+}
+
+
+// Evaluates origin, up vector and targets of all end branches, each target is evaluated exactly once
+void UMPAS_BranchingLimb::GatherSolveInput(FMPAS_LimbSolveInput& OutInput)
+{
+    OutInput.OriginLocation = GetComponentLocation();
+    OutInput.TargetLocation = OutInput.OriginLocation;
+    OutInput.UpVector = GetUpVector();
+
+    // Branches are solved without pole targets
+    OutInput.PoleTargets.Reset();
+
+    OutInput.BranchTargets.SetNum(Layout.IsEndBranch.Num(), EAllowShrinking::No);
+    for (int32 b = 0; b < OutInput.BranchTargets.Num(); b++)
+        OutInput.BranchTargets[b] = Layout.IsEndBranch[b] ? GetBranchTarget(b) : FVector::ZeroVector;
+}
+
+// Copies the layout and the targets and wraps multi-end FABRIK into a task
+FMPAS_LimbSolveTask UMPAS_BranchingLimb::MakeSolveTask(int32 InMaxIterations, bool InWarmStart)
+{
+    // Multi-end FABRIK always continues from the latest solution, so there is nothing to warm-start
+    const FVector L_Origin = SolveInput.OriginLocation;
+    const FVector L_UpVector = SolveInput.UpVector;
+    const TArray<FVector> L_Targets = SolveInput.BranchTargets;
+    const FMPAS_BranchingLimbLayout L_Layout = Layout;
+    const TArray<FMPAS_LimbSegmentState> L_State = TargetState;
+    const int32 L_MaxIterations = InMaxIterations;
+    const float L_Tollerance = IK_ErrorTollerance;
+    const bool L_ApplyAngularLimits = EnableAngularLimits;
+
+    return [L_Origin, L_UpVector, L_Targets, L_Layout, L_State, L_MaxIterations, L_Tollerance, L_ApplyAngularLimits] (bool& OutConverged, int32& OutIterations, float& OutError)
+    {
+        return Solve_MultiEndFABRIK_IK(L_Origin, L_Targets, L_Layout, L_State, L_MaxIterations, L_Tollerance, L_UpVector, L_ApplyAngularLimits, OutConverged, OutIterations, OutError);
+    };
+}
+
+
+// Multi-end FABRIK: end branches reach for their targets, junctions are placed at the weighted centroid of the bases of their child branches, then all branches are reattached from the origin
+TArray<FMPAS_LimbSegmentState> UMPAS_BranchingLimb::Solve_MultiEndFABRIK_IK(const FVector& InOriginLocation, const TArray<FVector>& InTargets, const FMPAS_BranchingLimbLayout& InLayout, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InApplyAngularLimits, bool& OutConverged, int32& OutIterations, float& OutError)
+{
+    TArray<FMPAS_LimbSegmentState> State = InCurrentState;
+
+    const int32 L_BranchNum = InLayout.Offsets.Num();
+
+    // Weighted sums of the bases of the child branches, accumulated for each junction during the backward pass
+    TArray<FVector> L_JunctionSums;
+    TArray<float> L_JunctionWeights;
+    L_JunctionSums.SetNum(L_BranchNum);
+    L_JunctionWeights.SetNum(L_BranchNum);
+
+    // Largest distance between the tip of an end branch and it's target
+    auto CalculateError = [&]()
+    {
+        float Error = 0.f;
+        for (int32 b = 0; b < L_BranchNum; b++)
+            if (InLayout.IsEndBranch[b])
+                Error = FMath::Max(Error, (State[InLayout.Offsets[b] + InLayout.SegmentCounts[b]].Location - InTargets[b]).Size());
+
+        return Error;
+    };
+
+    float Error = CalculateError();
+    int32 Iteration = 0;
+
+    while (Iteration < InMaxIterations && Error > InTollerance)
+    {
+        for (int32 b = 0; b < L_BranchNum; b++)
+        {
+            L_JunctionSums[b] = FVector::ZeroVector;
+            L_JunctionWeights[b] = 0.f;
+        }
+
+        // Forward-Reaching pass (children are processed before their parents)
+        for (int32 b = L_BranchNum - 1; b >= 0; b--)
+        {
+            const int32 O = InLayout.Offsets[b];
+            const int32 N = InLayout.SegmentCounts[b];
+
+            if (InLayout.IsEndBranch[b])
+                State[O + N].Location = InTargets[b];
+
+            else if (L_JunctionWeights[b] > 0.f)
+                State[O + N].Location = L_JunctionSums[b] / L_JunctionWeights[b];
+
+            for (int32 i = N; i > 0; i--)
+            {
+                FVector DirectionVector = (State[O + i - 1].Location - State[O + i].Location).GetSafeNormal();
+
+                // Angular limits
+                if (InApplyAngularLimits && i > 1 && InLayout.Segments[O + i - 1].AngularLimitModel == EMPAS_LimbAngularLimitModel::SwingTwist)
+                {
+                    const FVector ParentDirection = (State[O + i - 1].Location - State[O + i - 2].Location).GetSafeNormal();
+                    DirectionVector = -1 * UMPAS_Limb::ClampSegmentDirection(-1 * DirectionVector, ParentDirection, InLayout.Segments[O + i - 1]);
+                }
+
+                State[O + i - 1].Location = State[O + i].Location + DirectionVector * InLayout.Segments[O + i - 1].Length;
+            }
+
+            // Contributing to the junction of the parent branch
+            const int32 L_Parent = InLayout.Parents[b];
+            if (L_Parent >= 0)
+            {
+                L_JunctionSums[L_Parent] += State[O].Location * InLayout.Weights[b];
+                L_JunctionWeights[L_Parent] += InLayout.Weights[b];
+            }
+        }
+
+        // Backward-Reaching pass (parents are processed before their children)
+        for (int32 b = 0; b < L_BranchNum; b++)
+        {
+            const int32 O = InLayout.Offsets[b];
+            const int32 N = InLayout.SegmentCounts[b];
+            const int32 L_Parent = InLayout.Parents[b];
+
+            State[O].Location = (L_Parent >= 0) ? State[InLayout.Offsets[L_Parent] + InLayout.SegmentCounts[L_Parent]].Location : InOriginLocation;
+
+            for (int32 i = 0; i < N; i++)
+            {
+                FVector DirectionVector = (State[O + i + 1].Location - State[O + i].Location).GetSafeNormal();
+
+                // Angular limits (the first segment of a branch is limited relative to the last segment of the parent branch)
+                if (InApplyAngularLimits && InLayout.Segments[O + i].AngularLimitModel == EMPAS_LimbAngularLimitModel::SwingTwist)
+                {
+                    FVector ParentDirection = FVector::ZeroVector;
+
+                    if (i > 0)
+                        ParentDirection = (State[O + i].Location - State[O + i - 1].Location).GetSafeNormal();
+
+                    else if (L_Parent >= 0 && InLayout.SegmentCounts[L_Parent] > 0)
+                    {
+                        const int32 L_ParentTip = InLayout.Offsets[L_Parent] + InLayout.SegmentCounts[L_Parent];
+                        ParentDirection = (State[L_ParentTip].Location - State[L_ParentTip - 1].Location).GetSafeNormal();
+                    }
+
+                    if (!ParentDirection.IsZero())
+                        DirectionVector = UMPAS_Limb::ClampSegmentDirection(DirectionVector, ParentDirection, InLayout.Segments[O + i]);
+                }
+
+                State[O + i + 1].Location = State[O + i].Location + DirectionVector * InLayout.Segments[O + i].Length;
+            }
+        }
+
+        Iteration++;
+        Error = CalculateError();
+    }
+
+    // Directions are only converted to rotations once, after the last iteration
+    for (int32 b = 0; b < L_BranchNum; b++)
+    {
+        const int32 O = InLayout.Offsets[b];
+        const int32 N = InLayout.SegmentCounts[b];
+
+        for (int32 i = 0; i < N; i++)
+        {
+            const FVector DirectionVector = (State[O + i + 1].Location - State[O + i].Location).GetSafeNormal();
+            State[O + i].Rotation = FRotationMatrix::MakeFromXZ(DirectionVector, InUpVector).Rotator();
+        }
+
+        if (N > 0)
+            State[O + N].Rotation = State[O + N - 1].Rotation;
+    }
+
+    OutConverged = Error <= InTollerance;
+    OutIterations = Iteration;
+    OutError = Error;
+
+    return State;
+}
+
+
+// CALLED BY THE HANDLER : Initializing Rig Element
+void UMPAS_BranchingLimb::InitRigElement(class UMPAS_Handler* InHandler)
+{
+    // Skipping limb's target and pole target stacks, end branches register their own target stacks
+    UMPAS_VoidRigElement::InitRigElement(InHandler);
+
+    InitLimb();
+}
+
+// CALLED BY THE HANDLER : Contains the logic that links this element with other elements in the rig
+void UMPAS_BranchingLimb::LinkRigElement(class UMPAS_Handler* InHandler)
+{
+    Super::LinkRigElement(InHandler);
+
+    ChildTargetElements.Reset();
+
+    if (TargetType == EMPAS_LimbTargetType::FirstChildComponent)
+        for (const FName& ChildName : GetHandler()->GetRigData()[RigElementName].ChildElements)
+            ChildTargetElements.Add(GetHandler()->GetRigData()[ChildName].RigElement);
+
+    AssignBranchTargets();
+}
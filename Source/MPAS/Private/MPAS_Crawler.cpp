@@ -62,6 +62,9 @@ void UMPAS_Crawler::UpdateRigElement(float DeltaTime)
 // Checks if there is ground under the crawler
 bool UMPAS_Crawler::GroundCheck(FHitResult& Hit)
 {
+	if (GetHandler())
+		return GetHandler()->QueryGround(GetComponentLocation(), GetComponentLocation() - GetUpVector() * GroundCheckDistance, Hit, GroundCheckCollisionChannel);
+
 	return GetWorld()->LineTraceSingleByChannel(Hit, GetComponentLocation(), GetComponentLocation() - GetUpVector() * GroundCheckDistance, GroundCheckCollisionChannel);
 }
 
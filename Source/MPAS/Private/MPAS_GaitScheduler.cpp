@@ -0,0 +1,163 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MPAS_GaitScheduler.h"
+#include "Default/RigElements/MPAS_Leg.h"
+
+
+// CALLED BY LEGS : Adds the leg to the group with the given ID, returns the gait index of the leg
+int32 FMPAS_GaitScheduler::RegisterLeg(UMPAS_Leg* InLeg, int32 InLegGroup)
+{
+	// Finding the group or the place to insert it at, keeping groups sorted
+	int32 Index = 0;
+	while (Index < Groups.Num() && Groups[Index].GroupID < InLegGroup)
+		Index++;
+
+	if (!Groups.IsValidIndex(Index) || Groups[Index].GroupID != InLegGroup)
+	{
+		FMPAS_LegGroup NewGroup;
+		NewGroup.GroupID = InLegGroup;
+
+		Groups.Insert(MoveTemp(NewGroup), Index);
+	}
+
+	Groups[Index].Legs.AddUnique(InLeg);
+
+	// Phase oscillator data is filled by BuildPhaseOffsets
+	PhaseOffsets.Add(0.f);
+	SwingFractions.Add(0.f);
+	SwingOpen.Add(false);
+	SwingOpened.Add(false);
+
+	return Legs.Add(InLeg);
+}
+
+// Removes all groups and resets the state
+void FMPAS_GaitScheduler::Reset()
+{
+	Groups.Reset();
+	CurrentGroupIndex = 0;
+	MovingLegsCount = 0;
+
+	Legs.Reset();
+	PhaseOffsets.Reset();
+	SwingFractions.Reset();
+	SwingOpen.Reset();
+	SwingOpened.Reset();
+	Phase = 0.f;
+}
+
+
+// CALLED BY LEGS : A leg has finished it's step (with respect to it's StepFinishTimeOffset), in LegGroups mode the next group is activated once no legs are moving
+void FMPAS_GaitScheduler::OnStepFinished()
+{
+	MovingLegsCount = FMath::Max(MovingLegsCount - 1, 0);
+
+	// Legs don't take turns in PhaseOscillator mode
+	if (MovingLegsCount == 0 && Mode == EMPAS_GaitMode::LegGroups)
+		AdvanceLegGroup();
+}
+
+// Activates the next leg group and notifies it's legs (returns the ID of the new group)
+int32 FMPAS_GaitScheduler::AdvanceLegGroup()
+{
+	if (Groups.Num() == 0)
+		return 0;
+
+	CurrentGroupIndex = (CurrentGroupIndex + 1) % Groups.Num();
+
+	// Only the legs of the new group are notified, legs that are waiting for their turn start stepping right away
+	const FMPAS_LegGroup& Group = Groups[CurrentGroupIndex];
+	for (int32 i = 0; i < Group.Legs.Num(); i++)
+		Group.Legs[i]->OnLegGroupActivated();
+
+	return Group.GroupID;
+}
+
+
+// Calculates phase offsets and swing fractions of all legs for the given pattern (InSwingFractionOverride <= 0 uses the pattern's default)
+void FMPAS_GaitScheduler::BuildPhaseOffsets(EMPAS_GaitPattern InPattern, float InSwingFractionOverride, const FTransform& InCoreTransform)
+{
+	const int32 LegNum = Legs.Num();
+	if (LegNum == 0)
+		return;
+
+	// Locations of the legs in core space (offsets relative to the parent body are the same for every segment of multi-segment rigs)
+	TArray<FVector> CoreSpaceLocations;
+	CoreSpaceLocations.SetNum(LegNum);
+	for (int32 i = 0; i < LegNum; i++)
+		CoreSpaceLocations[i] = InCoreTransform.InverseTransformPosition(Legs[i]->GetComponentLocation());
+
+	// Splitting legs by the side of the core, ordered front to back (stable, so legs at the same location keep the registration order)
+	TArray<int32> SideLegs[2];
+	for (int32 i = 0; i < LegNum; i++)
+		SideLegs[CoreSpaceLocations[i].Y < 0.f ? 0 : 1].Add(i);
+
+	for (int32 Side = 0; Side < 2; Side++)
+	{
+		SideLegs[Side].StableSort([&CoreSpaceLocations](const int32& A, const int32& B) { return CoreSpaceLocations[A].X > CoreSpaceLocations[B].X; });
+
+		const int32 SideNum = SideLegs[Side].Num();
+
+		for (int32 Rank = 0; Rank < SideNum; Rank++)
+		{
+			const int32 i = SideLegs[Side][Rank];
+
+			// Position of the leg, counting from the back
+			const int32 RankFromBack = SideNum - 1 - Rank;
+
+			float Offset = 0.f;
+			float SwingFraction = 0.5f;
+
+			switch (InPattern)
+			{
+			case EMPAS_GaitPattern::Wave:
+				Offset = (float)(Side * SideLegs[0].Num() + RankFromBack) / LegNum;
+				SwingFraction = 1.f / LegNum;
+				break;
+
+			case EMPAS_GaitPattern::Tripod:
+				Offset = 0.5f * (Rank % 2) + 0.5f * Side;
+				SwingFraction = 0.5f;
+				break;
+
+			case EMPAS_GaitPattern::Ripple:
+				Offset = (float)RankFromBack / SideNum + 0.5f * Side;
+				SwingFraction = 1.f / SideNum;
+				break;
+
+			case EMPAS_GaitPattern::Custom:
+				Offset = Legs[i]->GaitPhaseOffset;
+				SwingFraction = 0.5f;
+				break;
+
+			default: break;
+			}
+
+			PhaseOffsets[i] = FMath::Frac(Offset);
+			SwingFractions[i] = InSwingFractionOverride > 0.f ? FMath::Min(InSwingFractionOverride, 1.f) : SwingFraction;
+		}
+	}
+}
+
+// Advances the shared cycle by the given frequency and opens / closes swing windows of all legs in one pass, legs whose windows have opened are notified
+void FMPAS_GaitScheduler::UpdatePhases(float DeltaTime, float InCycleFrequency)
+{
+	Phase = FMath::Frac(Phase + DeltaTime * InCycleFrequency);
+
+	const int32 LegNum = Legs.Num();
+
+	// Pure arithmetic over flat arrays, no branching on leg state
+	for (int32 i = 0; i < LegNum; i++)
+	{
+		const bool Open = FMath::Frac(Phase - PhaseOffsets[i] + 1.f) < SwingFractions[i];
+
+		SwingOpened[i] = Open && !SwingOpen[i];
+		SwingOpen[i] = Open;
+	}
+
+	// Notifying legs, whose swing windows have just opened
+	for (int32 i = 0; i < LegNum; i++)
+		if (SwingOpened[i])
+			Legs[i]->OnLegGroupActivated();
+}
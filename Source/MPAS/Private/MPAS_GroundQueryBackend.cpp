@@ -0,0 +1,155 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Default/GroundQuery/MPAS_GroundQueryBackend.h"
+#include "Engine/World.h"
+#include "Engine/Level.h"
+#include "EngineUtils.h"
+#include "LandscapeProxy.h"
+#include "NavigationSystem.h"
+
+
+// PHYSICS
+
+bool UMPAS_PhysicsGroundQueryBackend::QueryGround(UWorld* InWorld, const FVector& InStart, const FVector& InEnd, ECollisionChannel InChannel, const FCollisionQueryParams& InQueryParams, FHitResult& OutHit)
+{
+	if (!InWorld) return false;
+	return InWorld->LineTraceSingleByChannel(OutHit, InStart, InEnd, OverrideChannel ? Channel.GetValue() : InChannel, InQueryParams);
+}
+
+
+// LANDSCAPE
+
+bool UMPAS_LandscapeGroundQueryBackend::QueryGround(UWorld* InWorld, const FVector& InStart, const FVector& InEnd, ECollisionChannel InChannel, const FCollisionQueryParams& InQueryParams, FHitResult& OutHit)
+{
+	if (!InWorld) return false;
+
+	// Gathering landscapes once per world (streamed in landscapes are added by OnLevelAddedToWorld)
+	if (LandscapesWorld.Get() != InWorld)
+	{
+		Landscapes.Reset();
+		LandscapesWorld = InWorld;
+
+		for (TActorIterator<ALandscapeProxy> It(InWorld); It; ++It)
+			Landscapes.Add(*It);
+	}
+
+	float Height;
+	if (GetLandscapeHeight(InStart, Height))
+	{
+		const float MinHeight = FMath::Min(InStart.Z, InEnd.Z);
+		const float MaxHeight = FMath::Max(InStart.Z, InEnd.Z);
+
+		if (Height >= MinHeight && Height <= MaxHeight)
+		{
+			// Normal from central differences (falls back to the up vector near landscape borders)
+			float HeightX0, HeightX1, HeightY0, HeightY1;
+			FVector Normal = FVector::UpVector;
+
+			if (GetLandscapeHeight(InStart - FVector(NormalSampleDistance, 0, 0), HeightX0) && GetLandscapeHeight(InStart + FVector(NormalSampleDistance, 0, 0), HeightX1)
+				&& GetLandscapeHeight(InStart - FVector(0, NormalSampleDistance, 0), HeightY0) && GetLandscapeHeight(InStart + FVector(0, NormalSampleDistance, 0), HeightY1))
+				Normal = FVector(HeightX0 - HeightX1, HeightY0 - HeightY1, 2.f * NormalSampleDistance).GetSafeNormal();
+
+			OutHit = FHitResult(InStart, InEnd);
+			OutHit.bBlockingHit = true;
+			OutHit.Location = FVector(InStart.X, InStart.Y, Height);
+			OutHit.ImpactPoint = OutHit.Location;
+			OutHit.Normal = Normal;
+			OutHit.ImpactNormal = Normal;
+			OutHit.Time = FMath::Abs(InStart.Z - InEnd.Z) > KINDA_SMALL_NUMBER ? (InStart.Z - Height) / (InStart.Z - InEnd.Z) : 0.f;
+
+			return true;
+		}
+	}
+
+	if (FallbackToTrace)
+		return InWorld->LineTraceSingleByChannel(OutHit, InStart, InEnd, InChannel, InQueryParams);
+
+	return false;
+}
+
+void UMPAS_LandscapeGroundQueryBackend::PostInitProperties()
+{
+	Super::PostInitProperties();
+
+	if (!HasAnyFlags(RF_ClassDefaultObject))
+		LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UMPAS_LandscapeGroundQueryBackend::OnLevelAddedToWorld);
+}
+
+void UMPAS_LandscapeGroundQueryBackend::BeginDestroy()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+
+	Super::BeginDestroy();
+}
+
+// Picks up landscape proxies of levels, streamed into the gathered world (level streaming, World Partition cells)
+void UMPAS_LandscapeGroundQueryBackend::OnLevelAddedToWorld(ULevel* InLevel, UWorld* InWorld)
+{
+	// Landscapes of other worlds are not needed, and a world that wasn't gathered yet will be gathered as a whole
+	if (!InLevel || InWorld != LandscapesWorld.Get())
+		return;
+
+	for (AActor* Actor : InLevel->Actors)
+		if (ALandscapeProxy* Landscape = Cast<ALandscapeProxy>(Actor))
+			Landscapes.AddUnique(Landscape);
+}
+
+// Height of the landscape at the given location, false if there is no landscape under it
+bool UMPAS_LandscapeGroundQueryBackend::GetLandscapeHeight(const FVector& InLocation, float& OutHeight)
+{
+	for (int32 i = 0; i < Landscapes.Num(); i++)
+	{
+		ALandscapeProxy* Landscape = Landscapes[i].Get();
+
+		// The landscape was unloaded, landscapes will be gathered again on the next query
+		if (!Landscape)
+		{
+			LandscapesWorld.Reset();
+			continue;
+		}
+
+		TOptional<float> Height = Landscape->GetHeightAtLocation(InLocation);
+		if (Height.IsSet())
+		{
+			OutHeight = Height.GetValue();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// NAVMESH
+
+bool UMPAS_NavMeshGroundQueryBackend::QueryGround(UWorld* InWorld, const FVector& InStart, const FVector& InEnd, ECollisionChannel InChannel, const FCollisionQueryParams& InQueryParams, FHitResult& OutHit)
+{
+	if (!InWorld) return false;
+
+	UNavigationSystemV1* NavigationSystem = FNavigationSystem::GetCurrent<UNavigationSystemV1>(InWorld);
+	if (NavigationSystem)
+	{
+		// Projecting the middle of the query, the extent covers the whole query vertically
+		const FVector QueryCenter = (InStart + InEnd) / 2;
+		const FVector QueryExtent = FVector(ProjectionHorizontalExtent, ProjectionHorizontalExtent, FMath::Abs(InStart.Z - InEnd.Z) / 2);
+
+		FNavLocation Projected;
+		if (NavigationSystem->ProjectPointToNavigation(QueryCenter, Projected, QueryExtent))
+		{
+			OutHit = FHitResult(InStart, InEnd);
+			OutHit.bBlockingHit = true;
+			OutHit.Location = Projected.Location - FVector::UpVector * NavMeshHeightOffset;
+			OutHit.ImpactPoint = OutHit.Location;
+			OutHit.Normal = FVector::UpVector;
+			OutHit.ImpactNormal = FVector::UpVector;
+
+			return true;
+		}
+	}
+
+	if (FallbackToTrace)
+		return InWorld->LineTraceSingleByChannel(OutHit, InStart, InEnd, InChannel, InQueryParams);
+
+	return false;
+}
@@ -5,11 +5,20 @@
 #include "Default/MPAS_Core.h"
 #include "MPAS_RigElement.h"
 #include "Default/RigElements/MPAS_VoidRigElement.h"
+#include "Default/RigElements/MPAS_Limb.h"
+#include "Default/RigElements/MPAS_Piston.h"
+#include "Default/RigElements/MPAS_Leg.h"
+#include "Default/GroundQuery/MPAS_GroundQueryBackend.h"
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "Curves/CurveFloat.h"
 #include "Default/RigElements/PositionDrivers/MPAS_PositionDriver.h"
 
 
+// Name of the int parameter, that mirrors the current leg group of the gait scheduler
+static const FName GMPAS_CurrentLegGroupParameterName("CurrentLegGroup");
+
+
 // Sets default values for this component's properties
 UMPAS_Handler::UMPAS_Handler()
 {
@@ -35,11 +44,23 @@ void UMPAS_Handler::BeginPlay()
 	// Initialize rig after scanning
 	InitRig();
 
+	// Legs have registered in the gait scheduler during initialization
+	CreateIntParameter(GMPAS_CurrentLegGroupParameterName, GaitScheduler.GetCurrentLegGroup());
+
 	// Lings rig after initializing
 	LinkRig();
 
 	// Finalizes rig elements' setup
 	PostLinkSetupRig();
+
+	// Legs know their resting offsets after linking
+	BuildGait();
+
+	// Packs pistons after their targets are linked
+	BuildPistonBatch();
+
+	// Allocates terrain cache (cells are traced during the following updates)
+	BuildTerrainCache();
 	
 	SetupComplete = true;
 
@@ -60,11 +81,30 @@ void UMPAS_Handler::TickComponent(float DeltaTime, ELevelTick TickType, FActorCo
 	// Synchronizing rig elements with the fetched bone transforms
 	SyncBoneTransforms(DeltaTime);
 
+	// Opening swing windows of the legs before they update
+	UpdateGait(DeltaTime);
+
+	// Moving the feet of the legs, that are making steps
+	UpdateStepAnimations(DeltaTime);
+
 	// Updates rig every tick
 	UpdateRig(DeltaTime);
 
+	// Distributing IK iterations between the limbs, that have gathered changed inputs during the rig update, and solving them
+	AllocateIKBudget();
+	DispatchLimbSolves();
+
+	// Extends all pistons at once, using the inputs they've submitted during the rig update
+	SolvePistons();
+
 	// Updates intention driver
 	UpdateIntentionDriver(DeltaTime);
+
+	// Refreshes a few cells of the terrain cache around the core
+	RefreshTerrainCache();
+
+	// Starts all foot traces, requested by the legs during this update, at once
+	DispatchFootTraces();
 }
 
 
@@ -121,6 +161,24 @@ void UMPAS_Handler::ScanElement(UMPAS_RigElement* RigElement, const FName& Paren
 
 		PositionDrivers.Add(UniqueName, PositionDriver);
 	}
+
+	// Registering limbs for IK budget distribution
+	UMPAS_Limb* Limb = Cast<UMPAS_Limb>(RigElement);
+	if (Limb)
+		Limbs.Add(Limb);
+
+	// Registering pistons for the batch evaluation
+	UMPAS_Piston* Piston = Cast<UMPAS_Piston>(RigElement);
+	if (Piston)
+		Pistons.Add(Piston);
+
+	// Registering legs for the batched foot traces
+	UMPAS_Leg* Leg = Cast<UMPAS_Leg>(RigElement);
+	if (Leg)
+	{
+		Leg->SetFootTraceIndex(FootTraceLegs.Add(Leg));
+		FootTraceRequests.AddDefaulted(FootTraceSlotNum);
+	}
 	
 	// Getting all children of this element
 	TArray<USceneComponent*> CoreChildComponents;
@@ -188,9 +246,207 @@ void UMPAS_Handler::UpdateRig(float DeltaTime)
 {
 	for (auto& RigElement : RigData)
 		RigElement.Value.RigElement->UpdateRigElement(DeltaTime);
+
+	// Elements, that depend on final desired transforms of other elements
+	for (auto& RigElement : RigData)
+		RigElement.Value.RigElement->PostUpdateRigElement(DeltaTime);
+}
+
+
+// Distributes IK_IterationBudget between limbs by their priority, limbs that didn't get any iterations keep their last pose
+void UMPAS_Handler::AllocateIKBudget()
+{
+	// Unlimited budget
+	if (IK_IterationBudget <= 0)
+	{
+		for (UMPAS_Limb* Limb : Limbs)
+			Limb->SetGrantedIterations(-1);
+
+		return;
+	}
+
+	IKBudgetCandidates.Reset();
+
+	for (UMPAS_Limb* Limb : Limbs)
+	{
+		if (Limb->RequiresIterationBudget())
+			IKBudgetCandidates.Add(TPair<float, UMPAS_Limb*>(Limb->GetIterationBudgetPriority(), Limb));
+
+		// Limbs that don't iterate or don't solve on this update, don't need any iterations
+		else
+			Limb->SetGrantedIterations(-1);
+	}
+
+	IKBudgetCandidates.Sort([](const TPair<float, UMPAS_Limb*>& A, const TPair<float, UMPAS_Limb*>& B) { return A.Key > B.Key; });
+
+	// First pass : granting estimated amount of iterations in order of priority
+	int32 RemainingBudget = IK_IterationBudget;
+	for (auto& Candidate : IKBudgetCandidates)
+	{
+		const int32 Granted = FMath::Min(Candidate.Value->GetEstimatedIterationNeed(), RemainingBudget);
+		
+		Candidate.Value->SetGrantedIterations(Granted);
+		RemainingBudget -= Granted;
+	}
+
+	// Second pass : distributing the remaining budget (limbs, that converge early, will simply not use it)
+	for (auto& Candidate : IKBudgetCandidates)
+	{
+		if (RemainingBudget <= 0)
+			break;
+
+		const int32 Granted = FMath::Min(Candidate.Value->IK_MaxIterations, Candidate.Value->GetEstimatedIterationNeed() + RemainingBudget);
+		
+		RemainingBudget -= Granted - FMath::Min(Candidate.Value->GetEstimatedIterationNeed(), Granted);
+		Candidate.Value->SetGrantedIterations(Granted);
+	}
+}
+
+
+// Solves the limbs, that have gathered changed inputs during the rig update
+void UMPAS_Handler::DispatchLimbSolves()
+{
+	for (UMPAS_Limb* Limb : Limbs)
+		Limb->DispatchPendingSolve();
 }
 
 
+// Packs all pistons into the batch, assigning their piston indices
+void UMPAS_Handler::BuildPistonBatch()
+{
+	const int32 PistonNum = Pistons.Num();
+
+	PistonBatch.Origins.SetNumZeroed(PistonNum);
+	PistonBatch.Targets.SetNumZeroed(PistonNum);
+	PistonBatch.UpVectors.Init(FVector::UpVector, PistonNum);
+	PistonBatch.Rolls.SetNum(PistonNum);
+	PistonBatch.Active.Init(false, PistonNum);
+	PistonBatch.Sequential.SetNum(PistonNum);
+	PistonBatch.MaxExtents.SetNum(PistonNum);
+	PistonBatch.StageOffsets.SetNum(PistonNum);
+	PistonBatch.StageCounts.SetNum(PistonNum);
+
+	PistonBatch.StageLengths.Reset();
+	PistonBatch.StageBones.Reset();
+
+	for (int32 i = 0; i < PistonNum; i++)
+	{
+		UMPAS_Piston* Piston = Pistons[i];
+
+		PistonBatch.Sequential[i] = Piston->ExtensionMode == EMPAS_PistonExtensionMode::Sequential;
+		PistonBatch.Rolls[i] = Piston->PistonRoll;
+		PistonBatch.MaxExtents[i] = Piston->GetMaxExtent();
+		PistonBatch.StageOffsets[i] = PistonBatch.StageLengths.Num();
+		PistonBatch.StageCounts[i] = Piston->Stages.Num();
+
+		for (const FMPAS_PistonStage& Stage : Piston->Stages)
+		{
+			PistonBatch.StageLengths.Add(Stage.Length);
+			PistonBatch.StageBones.Add(Stage.BoneName);
+		}
+
+		Piston->SetPistonIndex(i);
+	}
+
+	PistonBatch.StageLocations.SetNumZeroed(PistonBatch.StageLengths.Num());
+}
+
+// CALLED BY PISTONS : Submits piston's input for the current update
+void UMPAS_Handler::SetPistonInput(int32 InPistonIndex, const FVector& InOrigin, const FVector& InTarget, const FVector& InUpVector)
+{
+	if (!PistonBatch.Active.IsValidIndex(InPistonIndex))
+		return;
+
+	PistonBatch.Origins[InPistonIndex] = InOrigin;
+	PistonBatch.Targets[InPistonIndex] = InTarget;
+	PistonBatch.UpVectors[InPistonIndex] = InUpVector;
+	PistonBatch.Active[InPistonIndex] = true;
+}
+
+/*
+	Every stage only moves along the piston's axis, so the whole piston is a 1D problem: 
+	stage offsets along the axis are computed in closed form, locations are only reconstructed for the bone output.
+
+	Multi : all stages are retracted by the same proportion (1 - Distance / MaxExtent), the first stage is retracted together with the second one
+	Sequential : the required distance is covered by extending stages one by one, starting from the base
+*/
+void UMPAS_Handler::SolvePistons()
+{
+	for (int32 i = 0; i < PistonBatch.Active.Num(); i++)
+	{
+		if (!PistonBatch.Active[i])
+			continue;
+
+		// Inputs have to be resubmitted every update
+		PistonBatch.Active[i] = false;
+
+		const int32 Offset = PistonBatch.StageOffsets[i];
+		const int32 StageCount = PistonBatch.StageCounts[i];
+
+		if (StageCount == 0)
+			continue;
+
+		const FVector& Origin = PistonBatch.Origins[i];
+		const FVector ToTarget = PistonBatch.Targets[i] - Origin;
+		const float Distance = ToTarget.Size();
+
+		const FVector Direction = ToTarget.GetSafeNormal();
+
+		// All stages share the rotation: facing the target, with the up axis kept towards piston's up vector and rolled around the axis
+		FQuat AxisRotation = FRotationMatrix::MakeFromXZ(Direction, PistonBatch.UpVectors[i]).ToQuat();
+		if (PistonBatch.Rolls[i] != 0.f)
+			AxisRotation = AxisRotation * FQuat(FVector::ForwardVector, FMath::DegreesToRadians(PistonBatch.Rolls[i]));
+
+		const FRotator Rotation = AxisRotation.Rotator();
+
+		const float* Lengths = PistonBatch.StageLengths.GetData() + Offset;
+
+		// Offset of the current stage along the piston's axis
+		float AxisOffset = 0.f;
+
+		if (!PistonBatch.Sequential[i])
+		{
+			const float Retraction = 1.f - FMath::Clamp(Distance / FMath::Max(PistonBatch.MaxExtents[i], KINDA_SMALL_NUMBER), 0.f, 1.f);
+
+			for (int32 Stage = 1; Stage < StageCount; Stage++)
+			{
+				const float RetractedLength = (Stage == 1) ? Lengths[0] + Lengths[1] : Lengths[Stage];
+
+				AxisOffset += Lengths[Stage - 1] - RetractedLength * Retraction;
+				PistonBatch.StageLocations[Offset + Stage] = Origin + Direction * AxisOffset;
+			}
+		}
+
+		else
+		{
+			float RequiredDistance = FMath::Max(Distance - Lengths[0], 0.f);
+
+			for (int32 Stage = 1; Stage < StageCount; Stage++)
+			{
+				const float Extension = FMath::Clamp(RequiredDistance / FMath::Max(Lengths[Stage], KINDA_SMALL_NUMBER), 0.f, 1.f);
+
+				AxisOffset += Lengths[Stage - 1] - Lengths[Stage] * (1.f - Extension);
+				PistonBatch.StageLocations[Offset + Stage] = Origin + Direction * AxisOffset;
+
+				RequiredDistance = FMath::Max(RequiredDistance - Lengths[Stage] * Extension, 0.f);
+			}
+		}
+
+		PistonBatch.StageLocations[Offset] = Origin;
+
+		// Bone output
+		for (int32 Stage = 0; Stage < StageCount; Stage++)
+		{
+			const FName& Bone = PistonBatch.StageBones[Offset + Stage];
+			if (Bone != FName())
+			{
+				SetBoneLocation(Bone, PistonBatch.StageLocations[Offset + Stage]);
+				SetBoneRotation(Bone, Rotation);
+			}
+		}
+	}
+}
+
 
 // Locates or creates a new timer controller
 void UMPAS_Handler::InitTimerController()
@@ -503,4 +759,426 @@ void UMPAS_Handler::PropogateFromElement(TArray<FName>& OutPropogation, FName In
 	
 	if (RigData.Contains(InStartingElement))
 		Propogation_ProcessElement(OutPropogation, InStartingElement, InPropogationSettings, 0);
-}
\ No newline at end of file
+}
+
+
+// CALLED BY LEGS : Requests an asynchronous foot trace in the given slot (a repeated request in the same slot overrides the previous one)
+void UMPAS_Handler::RequestFootTrace(int32 InFootTraceIndex, int32 InSlot, const FVector& InStart, const FVector& InEnd)
+{
+	const int32 RequestIndex = InFootTraceIndex * FootTraceSlotNum + InSlot;
+	if (!FootTraceRequests.IsValidIndex(RequestIndex) || InSlot < 0 || InSlot >= FootTraceSlotNum)
+		return;
+
+	FMPAS_FootTraceRequest& Request = FootTraceRequests[RequestIndex];
+	Request.Start = InStart;
+	Request.End = InEnd;
+	Request.Pending = true;
+}
+
+// Starts asynchronous traces for all foot trace requests made during this update (results are delivered to the legs next frame)
+void UMPAS_Handler::DispatchFootTraces()
+{
+	if (!GetWorld())
+		return;
+
+	// Legs query the ground synchronously, if the backend is not physics based
+	if (!UsesAsyncGroundQueries())
+	{
+		for (FMPAS_FootTraceRequest& Request : FootTraceRequests)
+			Request.Pending = false;
+
+		return;
+	}
+
+	if (!FootTraceDelegate.IsBound())
+		FootTraceDelegate.BindUObject(this, &UMPAS_Handler::OnFootTraceCompleted);
+
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MPAS_FootTrace), false);
+
+	for (int32 i = 0; i < FootTraceRequests.Num(); i++)
+	{
+		FMPAS_FootTraceRequest& Request = FootTraceRequests[i];
+		if (!Request.Pending)
+			continue;
+
+		Request.Pending = false;
+
+		// Request index is passed as user data, so the result can be routed back to the leg and the slot
+		GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, Request.Start, Request.End, ECC_Visibility, QueryParams, FCollisionResponseParams::DefaultResponseParam, &FootTraceDelegate, (uint32)i);
+	}
+}
+
+// Called when an asynchronous foot trace is completed, delivers the result to the leg, that has requested it
+void UMPAS_Handler::OnFootTraceCompleted(const FTraceHandle& InTraceHandle, FTraceDatum& InTraceDatum)
+{
+	const int32 RequestIndex = (int32)InTraceDatum.UserData;
+	const int32 LegIndex = RequestIndex / FootTraceSlotNum;
+
+	if (!FootTraceLegs.IsValidIndex(LegIndex) || !IsValid(FootTraceLegs[LegIndex]))
+		return;
+
+	const FHitResult* Hit = InTraceDatum.OutHits.Num() > 0 && InTraceDatum.OutHits[0].bBlockingHit ? &InTraceDatum.OutHits[0] : nullptr;
+	FootTraceLegs[LegIndex]->OnFootTraceCompleted(RequestIndex % FootTraceSlotNum, InTraceDatum.Start, InTraceDatum.End, Hit);
+}
+
+
+// Allocates the terrain cache, using current parameters (all cells are empty)
+void UMPAS_Handler::BuildTerrainCache()
+{
+	const int32 Resolution = FMath::Clamp(TerrainCache_Resolution, 2, 128);
+	const int32 SlotNum = Resolution * Resolution;
+
+	TerrainCache.Resolution = Resolution;
+	TerrainCache.CellSize = FMath::Max(TerrainCache_CellSize, 1.f);
+	TerrainCache.Cursor = 0;
+
+	TerrainCache.Cells.Init(FIntPoint(MAX_int32, MAX_int32), SlotNum);
+	TerrainCache.States.Init(EMPAS_TerrainCellState::Empty, SlotNum);
+	TerrainCache.Heights.Init(0.f, SlotNum);
+	TerrainCache.Normals.Init(FVector::UpVector, SlotNum);
+	TerrainCache.Timestamps.Init(0.f, SlotNum);
+	TerrainCache.Pending.Init(false, SlotNum);
+}
+
+// Starts asynchronous traces for up to TerrainCache_TracesPerUpdate missing or outdated cells around the core
+void UMPAS_Handler::RefreshTerrainCache()
+{
+	if (!EnableTerrainCache || !Core || !TerrainCache.IsValid() || !GetWorld())
+		return;
+
+	if (!TerrainTraceDelegate.IsBound())
+		TerrainTraceDelegate.BindUObject(this, &UMPAS_Handler::OnTerrainTraceCompleted);
+
+	const FVector CoreLocation = Core->GetComponentLocation();
+	const float CurrentTime = GetWorld()->GetTimeSeconds();
+
+	const int32 Resolution = TerrainCache.Resolution;
+	const int32 WindowSize = Resolution * Resolution;
+
+	// The window of cells, centered around the core, cells that leave it are overwritten by the ones that enter it
+	const FIntPoint WindowOrigin = TerrainCache.GetCell(CoreLocation) - FIntPoint(Resolution / 2, Resolution / 2);
+
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MPAS_TerrainCache), false, GetOwner());
+	const bool AsyncQueries = UsesAsyncGroundQueries();
+
+	// Checking window cells round-robin, until the trace budget is spent or the whole window was checked
+	int32 Traces = 0;
+	for (int32 Checked = 0; Checked < WindowSize && Traces < TerrainCache_TracesPerUpdate; Checked++)
+	{
+		const int32 WindowIndex = TerrainCache.Cursor;
+		TerrainCache.Cursor = (TerrainCache.Cursor + 1) % WindowSize;
+
+		const FIntPoint Cell = WindowOrigin + FIntPoint(WindowIndex % Resolution, WindowIndex / Resolution);
+		const int32 Slot = TerrainCache.GetSlot(Cell);
+
+		if (TerrainCache.Pending[Slot])
+			continue;
+
+		const bool IsStored = TerrainCache.Cells[Slot] == Cell && TerrainCache.States[Slot] != EMPAS_TerrainCellState::Empty;
+		if (IsStored && CurrentTime - TerrainCache.Timestamps[Slot] <= TerrainCache_MaxAge)
+			continue;
+
+		// A different cell is stored in the slot: it has left the window, so it's data is dropped
+		if (TerrainCache.Cells[Slot] != Cell)
+		{
+			TerrainCache.Cells[Slot] = Cell;
+			TerrainCache.States[Slot] = EMPAS_TerrainCellState::Empty;
+		}
+
+		const FVector CellCenter = FVector((Cell.X + 0.5f) * TerrainCache.CellSize, (Cell.Y + 0.5f) * TerrainCache.CellSize, CoreLocation.Z);
+
+		// Non-physics backends are queried right away
+		if (!AsyncQueries)
+		{
+			FHitResult Hit;
+			const bool HasHit = GroundQueryBackend->QueryGround(GetWorld(), CellCenter + FVector::UpVector * TerrainCache_TraceHalfHeight, CellCenter - FVector::UpVector * TerrainCache_TraceHalfHeight, TerrainCache_Channel, QueryParams, Hit);
+
+			TerrainCache.Timestamps[Slot] = CurrentTime;
+			WriteTerrainCell(Slot, HasHit ? &Hit : nullptr);
+
+			Traces++;
+			continue;
+		}
+
+		TerrainCache.Pending[Slot] = true;
+
+		// Slot is passed as user data, the cell is restored from the start of the trace
+		GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, CellCenter + FVector::UpVector * TerrainCache_TraceHalfHeight, CellCenter - FVector::UpVector * TerrainCache_TraceHalfHeight, TerrainCache_Channel, QueryParams, FCollisionResponseParams::DefaultResponseParam, &TerrainTraceDelegate, (uint32)Slot);
+
+		Traces++;
+	}
+}
+
+// Called when an asynchronous terrain cache trace is completed
+void UMPAS_Handler::OnTerrainTraceCompleted(const FTraceHandle& InTraceHandle, FTraceDatum& InTraceDatum)
+{
+	const int32 Slot = (int32)InTraceDatum.UserData;
+	if (!TerrainCache.Pending.IsValidIndex(Slot))
+		return;
+
+	TerrainCache.Pending[Slot] = false;
+
+	// The slot was reassigned (or the cache was rebuilt) while the trace was in flight
+	if (TerrainCache.Cells[Slot] != TerrainCache.GetCell(InTraceDatum.Start))
+		return;
+
+	TerrainCache.Timestamps[Slot] = GetWorld()->GetTimeSeconds();
+
+	const FHitResult* Hit = InTraceDatum.OutHits.Num() > 0 && InTraceDatum.OutHits[0].bBlockingHit ? &InTraceDatum.OutHits[0] : nullptr;
+	WriteTerrainCell(Slot, Hit);
+}
+
+// Writes the result of a ground query into the given slot of the terrain cache (InHit is nullptr if nothing was found)
+void UMPAS_Handler::WriteTerrainCell(int32 InSlot, const FHitResult* InHit)
+{
+	if (!InHit)
+	{
+		TerrainCache.States[InSlot] = EMPAS_TerrainCellState::NoGround;
+		return;
+	}
+
+	// Movable geometry can change at any moment, so the legs have to trace it directly
+	const UPrimitiveComponent* HitComponent = InHit->GetComponent();
+	if (HitComponent && HitComponent->Mobility == EComponentMobility::Movable)
+	{
+		TerrainCache.States[InSlot] = EMPAS_TerrainCellState::Dynamic;
+		return;
+	}
+
+	TerrainCache.States[InSlot] = EMPAS_TerrainCellState::Ground;
+	TerrainCache.Heights[InSlot] = InHit->ImpactPoint.Z;
+	TerrainCache.Normals[InSlot] = InHit->ImpactNormal;
+}
+
+/*
+ * Samples the terrain cache at the given location (bilinear between the 4 nearest cells)
+ * Returns false if any of these cells is missing, outdated, dynamic, has no ground or lies across an edge - the caller should trace instead
+ */
+bool UMPAS_Handler::SampleTerrainCache(const FVector& InLocation, float& OutHeight, FVector& OutNormal)
+{
+	if (!EnableTerrainCache || !TerrainCache.IsValid() || !GetWorld())
+		return false;
+
+	const float CurrentTime = GetWorld()->GetTimeSeconds();
+
+	// Cell samples are located in cell centers
+	const float GridX = InLocation.X / TerrainCache.CellSize - 0.5f;
+	const float GridY = InLocation.Y / TerrainCache.CellSize - 0.5f;
+
+	const FIntPoint BaseCell(FMath::FloorToInt(GridX), FMath::FloorToInt(GridY));
+	const float AlphaX = GridX - BaseCell.X;
+	const float AlphaY = GridY - BaseCell.Y;
+
+	float Heights[4];
+	FVector Normals[4];
+
+	for (int32 i = 0; i < 4; i++)
+	{
+		const FIntPoint Cell = BaseCell + FIntPoint(i & 1, i >> 1);
+		const int32 Slot = TerrainCache.GetSlot(Cell);
+
+		if (TerrainCache.Cells[Slot] != Cell
+			|| TerrainCache.States[Slot] != EMPAS_TerrainCellState::Ground
+			|| CurrentTime - TerrainCache.Timestamps[Slot] > TerrainCache_MaxAge)
+			return false;
+
+		Heights[i] = TerrainCache.Heights[Slot];
+		Normals[i] = TerrainCache.Normals[Slot];
+	}
+
+	// Interpolating across an edge (a wall, a step) would place the foot in the air
+	const float MinHeight = FMath::Min(FMath::Min(Heights[0], Heights[1]), FMath::Min(Heights[2], Heights[3]));
+	const float MaxHeight = FMath::Max(FMath::Max(Heights[0], Heights[1]), FMath::Max(Heights[2], Heights[3]));
+	if (MaxHeight - MinHeight > TerrainCache_MaxHeightDifference)
+		return false;
+
+	OutHeight = FMath::BiLerp(Heights[0], Heights[1], Heights[2], Heights[3], AlphaX, AlphaY);
+	OutNormal = FMath::BiLerp(Normals[0], Normals[1], Normals[2], Normals[3], AlphaX, AlphaY).GetSafeNormal(SMALL_NUMBER, FVector::UpVector);
+
+	return true;
+}
+
+// Empties cells within the radius around the location (call when geometry there changes)
+void UMPAS_Handler::InvalidateTerrainCache(const FVector& InLocation, float InRadius)
+{
+	if (!TerrainCache.IsValid())
+		return;
+
+	const float RadiusSquared = InRadius * InRadius;
+
+	for (int32 Slot = 0; Slot < TerrainCache.Cells.Num(); Slot++)
+	{
+		const FIntPoint& Cell = TerrainCache.Cells[Slot];
+		const FVector2D CellCenter((Cell.X + 0.5f) * TerrainCache.CellSize, (Cell.Y + 0.5f) * TerrainCache.CellSize);
+
+		if (FVector2D::DistSquared(CellCenter, FVector2D(InLocation.X, InLocation.Y)) <= RadiusSquared)
+			TerrainCache.States[Slot] = EMPAS_TerrainCellState::Empty;
+	}
+}
+
+
+// Looks for the ground on the segment from InStart to InEnd, using selected ground query backend
+bool UMPAS_Handler::QueryGround(const FVector& InStart, const FVector& InEnd, FHitResult& OutHit, ECollisionChannel InChannel)
+{
+	if (!GetWorld())
+		return false;
+
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MPAS_GroundQuery), false);
+
+	if (GroundQueryBackend)
+		return GroundQueryBackend->QueryGround(GetWorld(), InStart, InEnd, InChannel, QueryParams, OutHit);
+
+	return GetWorld()->LineTraceSingleByChannel(OutHit, InStart, InEnd, InChannel, QueryParams);
+}
+
+// Whether ground queries are physics traces, that can be performed asynchronously (foot traces and terrain cache are queried synchronously otherwise)
+bool UMPAS_Handler::UsesAsyncGroundQueries()
+{
+	return !GroundQueryBackend || GroundQueryBackend->SupportsAsyncQueries();
+}
+
+
+// CALLED BY LEGS : A leg has finished it's step, activates the next leg group once no legs are moving
+void UMPAS_Handler::NotifyLegStepFinished()
+{
+	const int32 PreviousLegGroup = GaitScheduler.GetCurrentLegGroup();
+
+	GaitScheduler.OnStepFinished();
+
+	// Mirroring the new group for Blueprints
+	if (GaitScheduler.GetCurrentLegGroup() != PreviousLegGroup)
+		SetIntParameter(GMPAS_CurrentLegGroupParameterName, GaitScheduler.GetCurrentLegGroup());
+}
+
+// Calculates phase offsets of the legs after the rig is linked
+void UMPAS_Handler::BuildGait()
+{
+	GaitScheduler.BuildPhaseOffsets(GaitPattern, Gait_SwingFractionOverride, Core ? Core->GetComponentTransform() : GetOwner()->GetActorTransform());
+
+	if (Core)
+		GaitPreviousCoreLocation = Core->GetComponentLocation();
+}
+
+// Advances the gait cycle by the speed of the core (PhaseOscillator mode)
+void UMPAS_Handler::UpdateGait(float DeltaTime)
+{
+	GaitScheduler.SetMode(GaitMode);
+
+	if (GaitMode != EMPAS_GaitMode::PhaseOscillator || !Core || DeltaTime <= 0.f)
+		return;
+
+	// Measuring horizontal speed of the core (the core is moved by intention drivers, so it has no physical velocity)
+	const FVector CoreLocation = Core->GetComponentLocation();
+	const float CurrentSpeed = FVector::Dist2D(CoreLocation, GaitPreviousCoreLocation) / DeltaTime;
+	GaitPreviousCoreLocation = CoreLocation;
+
+	GaitSpeed = FMath::FInterpTo(GaitSpeed, CurrentSpeed, DeltaTime, 10.f);
+
+	const float CycleFrequency = FMath::Clamp(GaitSpeed / FMath::Max(Gait_StrideLength, 1.f), Gait_MinCycleFrequency, FMath::Max(Gait_MaxCycleFrequency, Gait_MinCycleFrequency));
+	GaitScheduler.UpdatePhases(DeltaTime, CycleFrequency);
+}
+
+
+// CALLED BY LEGS : Samples the curve into a lookup table (once per curve asset), returns the index of the baked curve ( -1 if the curve is nullptr)
+int32 UMPAS_Handler::BakeCurve(UCurveFloat* InCurve)
+{
+	if (!InCurve)
+		return -1;
+
+	if (const int32* ExistingIndex = BakedCurveIndices.Find(InCurve))
+		return *ExistingIndex;
+
+	FMPAS_BakedCurve BakedCurve;
+	BakedCurve.Offset = BakedCurveSamples.Num();
+	BakedCurve.SampleNum = FMath::Clamp(StepAnimation_CurveSamples, 2, 1024);
+
+	InCurve->GetTimeRange(BakedCurve.MinTime, BakedCurve.MaxTime);
+	if (BakedCurve.MaxTime - BakedCurve.MinTime < KINDA_SMALL_NUMBER)
+		BakedCurve.MaxTime = BakedCurve.MinTime + 1.f;
+
+	for (int32 i = 0; i < BakedCurve.SampleNum; i++)
+		BakedCurveSamples.Add(InCurve->GetFloatValue(FMath::Lerp(BakedCurve.MinTime, BakedCurve.MaxTime, (float)i / (BakedCurve.SampleNum - 1))));
+
+	const int32 Index = BakedCurves.Add(BakedCurve);
+	BakedCurveIndices.Add(InCurve, Index);
+
+	return Index;
+}
+
+// Evaluates a baked curve at the given time (clamped to the time range of the curve)
+float UMPAS_Handler::SampleBakedCurve(int32 InCurveIndex, float InTime) const
+{
+	const FMPAS_BakedCurve& BakedCurve = BakedCurves[InCurveIndex];
+
+	const float Position = FMath::Clamp((InTime - BakedCurve.MinTime) / (BakedCurve.MaxTime - BakedCurve.MinTime), 0.f, 1.f) * (BakedCurve.SampleNum - 1);
+	const int32 Sample = FMath::Min((int32)Position, BakedCurve.SampleNum - 2);
+
+	const float* Samples = BakedCurveSamples.GetData() + BakedCurve.Offset;
+	return FMath::Lerp(Samples[Sample], Samples[Sample + 1], Position - Sample);
+}
+
+// CALLED BY LEGS : Starts animating a step, returns the index of the step
+int32 UMPAS_Handler::StartStep(const FMPAS_ActiveStep& InStep)
+{
+	return ActiveSteps.Add(InStep);
+}
+
+// CALLED BY LEGS : Changes the target location and height of an active step (when a more precise foot location is found)
+void UMPAS_Handler::RetargetStep(int32 InStepIndex, const FVector& InTargetLocation, float InStepHeight)
+{
+	if (!ActiveSteps.IsValidIndex(InStepIndex))
+		return;
+
+	ActiveSteps[InStepIndex].TargetLocation = InTargetLocation;
+	ActiveSteps[InStepIndex].StepHeight = InStepHeight;
+}
+
+// Advances all active steps, moves the feet, and notifies legs and the gait scheduler about finished steps
+void UMPAS_Handler::UpdateStepAnimations(float DeltaTime)
+{
+	FinishedStepLegs.Reset();
+	FinishNotifiedStepNum = 0;
+
+	for (int32 i = 0; i < ActiveSteps.Num(); i++)
+	{
+		FMPAS_ActiveStep& Step = ActiveSteps[i];
+
+		Step.Time = FMath::Min(Step.Time + DeltaTime * Step.PlaybackSpeed, Step.Duration);
+
+		const float Alpha = Step.Time / Step.Duration;
+
+		// Default shapes match the ones, used when the leg has no curves
+		const float ExtentFactor = Step.ExtentCurve != -1 ? SampleBakedCurve(Step.ExtentCurve, Alpha) : Alpha;
+		const float HeightFactor = Step.HeightCurve != -1 ? SampleBakedCurve(Step.HeightCurve, Alpha) : 1.f - FMath::Abs((Alpha - 0.5f) * 2.f);
+
+		Step.Leg->SetStepAnimationLocation(FMath::Lerp(Step.StartLocation, Step.TargetLocation, ExtentFactor) + Step.UpVector * Step.StepHeight * HeightFactor);
+
+		if (!Step.FinishNotified && Step.Time >= Step.FinishNotifyTime)
+		{
+			Step.FinishNotified = true;
+			FinishNotifiedStepNum++;
+		}
+
+		if (Step.Time >= Step.Duration)
+			FinishedStepLegs.Add(Step.Leg);
+	}
+
+	// Removing finished steps (swapping the last step in, so the array stays packed)
+	for (int32 i = ActiveSteps.Num() - 1; i >= 0; i--)
+	{
+		if (ActiveSteps[i].Time < ActiveSteps[i].Duration)
+			continue;
+
+		ActiveSteps.RemoveAtSwap(i, 1, EAllowShrinking::No);
+
+		if (ActiveSteps.IsValidIndex(i))
+			ActiveSteps[i].Leg->SetActiveStepIndex(i);
+	}
+
+	// Notifications are sent after the loop, as they can start new steps
+	for (UMPAS_Leg* Leg : FinishedStepLegs)
+		Leg->OnStepAnimationFinished();
+
+	for (int32 i = 0; i < FinishNotifiedStepNum; i++)
+		NotifyLegStepFinished();
+}
@@ -20,32 +20,25 @@ void UMPAS_Leg::InitRigElement(UMPAS_Handler* InHandler)
 {
 	Super::InitRigElement(InHandler);
 
-	StepTimelineName = FName("LegStepTimeline_" + RigElementName.ToString());
-	InHandler->TimerController->CreateTimeline(StepTimelineName, StepAnimationDuration, false, false);
-	InHandler->TimerController->RegisterTimelineNotify(StepTimelineName, "StepFinishedNotify", StepAnimationDuration - StepFinishTimeOffset);
-	InHandler->TimerController->SubscribeToTimeline(StepTimelineName, this, "OnStepAnimationTimelineUpdated", "OnStepAnimationTimelineFinished", "OnStepAnimationTimelineNotify");
-
-	// Currently scheduled to move group of legs
-	InHandler->CreateIntParameter("CurrentLegGroup", 0);
-
-	// The number of legs, that are currently moving
-	InHandler->CreateIntParameter("CurrentlyMovingLegsCount", 0);
-
-	// The maximum ID of a leg group in the rig, after this group has finished moving, leg group resets to 0
-	if (!InHandler->IsIntParameterValid("MaxLegGroupID"))
-		InHandler->CreateIntParameter("MaxLegGroupID", LegGroup);
-
-	else if (LegGroup > InHandler->GetIntParameter("MaxLegGroupID"))
-		InHandler->SetIntParameter("MaxLegGroupID", LegGroup);
-
-	// The number of legs assigned to an individual leg group
-	if (!InHandler->IsIntParameterValid(FName("LegGroupSize_" + FString::FromInt(LegGroup))))
-		InHandler->CreateIntParameter(FName("LegGroupSize_" + FString::FromInt(LegGroup)), 1);
+	// Steps are animated by the handler, curves are baked into it's lookup tables
+	if (UseNativeStepAnimation)
+	{
+		StepHeightCurveIndex = InHandler->BakeCurve(StepAnimationHeightCurve);
+		StepExtentCurveIndex = InHandler->BakeCurve(StepAnimationExtentCurve);
+		StepHeightScalingCurveIndex = InHandler->BakeCurve(StepHeightScalingCurve);
+	}
 
+	// Legacy step animation, driven by a timeline
 	else
-		InHandler->SetIntParameter(FName("LegGroupSize_" + FString::FromInt(LegGroup)), InHandler->GetIntParameter(FName("LegGroupSize_" + FString::FromInt(LegGroup))) + 1);
+	{
+		StepTimelineName = FName("LegStepTimeline_" + RigElementName.ToString());
+		InHandler->TimerController->CreateTimeline(StepTimelineName, StepAnimationDuration, false, false);
+		InHandler->TimerController->RegisterTimelineNotify(StepTimelineName, "StepFinishedNotify", StepAnimationDuration - StepFinishTimeOffset);
+		InHandler->TimerController->SubscribeToTimeline(StepTimelineName, this, "OnStepAnimationTimelineUpdated", "OnStepAnimationTimelineFinished", "OnStepAnimationTimelineNotify");
+	}
 
-	InHandler->SubscribeToParameter("CurrentLegGroup", this, "OnParameterChanged");
+	// Leg groups take turns, coordinated by the handler's gait scheduler
+	GaitIndex = InHandler->GetGaitScheduler().RegisterLeg(this, LegGroup);
 
 
 	// Absolute location layer - overrides default stack layers before it, detaching the leg from it's parent and placing it in world space
@@ -100,9 +93,14 @@ void UMPAS_Leg::LinkRigElement(class UMPAS_Handler* InHandler)
 
 	// Get resting pose offset
 	LegRestingPoseOffset = GetComponentLocation() - ParentElement->GetComponentLocation();
+	LegRestingPoseOffsetLocal = ParentElement->GetComponentQuat().UnrotateVector(LegRestingPoseOffset);
 
 	ParentBody = Cast<UMPAS_BodySegment>(ParentElement);
 
+	// Until the first update the leg targets it's own location
+	CachedTargetLocation = GetComponentLocation();
+	CachedBasicTargetLocation = CachedTargetLocation;
+
 	// Initial Leg Placement
 	FVector TraceResult = FootTrace(ParentElement->GetComponentLocation() + ParentElement->GetComponentRotation().RotateVector(LegRestingPoseOffset));
 	if (TraceResult != FVector(0, 0, 0))
@@ -126,20 +124,6 @@ void UMPAS_Leg::UpdateRigElement(float DeltaTime)
 	/*if (FootBone != FName())
 		Handler->SetBoneTransform(FootBone, GetComponentTransform());*/
 
-	// Actual leg update
-
-	if (!IsMoving && !IsReadyToStep())
-		ReadyToStep = ShouldStep();
-
-	if (!IsMoving && !WaitingOnLegGroup && IsReadyToStep())
-	{
-		if (Handler->GetIntParameter("CurrentLegGroup") == LegGroup && !HasMovedInCurrentWindow)
-			StartStepAnimation();
-
-		else
-			WaitingOnLegGroup = true;
-	}
-
 	// If element is active 
 	if (GetRigElementActive())
 	{
@@ -216,25 +200,129 @@ void UMPAS_Leg::SyncToFetchedBoneTransforms(float DeltaTime)
 }
 
 
-// Returns leg's target location
-FVector UMPAS_Leg::GetTargetLocation()
+// CALLED BY THE HANDLER : Called every tick after all rig elements were updated, makes step decisions using the final desired transform of the parent body
+void UMPAS_Leg::PostUpdateRigElement(float DeltaTime)
+{
+	Super::PostUpdateRigElement(DeltaTime);
+
+	if (!ParentElement) return;
+
+	// The target is calculated once per update, all consumers read the cached value
+	UpdateTargetLocation();
+
+	// Actual leg update
+
+	if (!IsMoving && !IsReadyToStep())
+		ReadyToStep = ShouldStep();
+
+	// Prefetching ground at the target, while the leg waits for it's turn, so the step can start from a prediction
+	if (UseAsyncFootTrace && FootTraceIndex != -1 && !IsMoving && IsReadyToStep())
+		Handler->RequestFootTrace(FootTraceIndex, FootTraceSlot_Target, CachedTargetLocation + GetUpVector() * MaxFootElevation, CachedTargetLocation - GetUpVector() * MaxFootVerticalExtent);
+
+	if (!IsMoving && !WaitingOnLegGroup && IsReadyToStep())
+	{
+		if (Handler->GetGaitScheduler().CanLegStep(GaitIndex, LegGroup) && !HasMovedInCurrentWindow)
+			StartStepAnimation();
+
+		else
+			WaitingOnLegGroup = true;
+	}
+}
+
+
+// Calculates leg's target location and caches it for the current update
+void UMPAS_Leg::UpdateTargetLocation()
 {
 	// Basic target location calculation
 	if (ParentBody)
-		SetVectorSourceValue(LegTargetLocationStackID, 0, this, ParentBody->GetDesiredRotation().RotateVector(GetLegTargetOffset()) + ParentBody->GetDesiredLocation());
+	{
+		FVector DesiredLocation = ParentBody->GetDesiredLocation();
+		FQuat DesiredRotation = ParentBody->GetDesiredRotation().Quaternion();
+
+		// Extrapolating the desired transform of the body to the moment, when a step started now would land
+		if (EnableStepPrediction)
+		{
+			const float PredictionTime = StepAnimationDuration / FMath::Max(AnimationSpeedMultiplier * SpeedMultiplier, KINDA_SMALL_NUMBER) * StepPrediction_TimeScale;
+
+			// Movement input steers the measured velocity, keeping it's magnitude
+			FVector Velocity = ParentBody->GetDesiredVelocity();
+			const FVector InputDirection = GetHandler()->GetMovementInputDirection().GetClampedToMaxSize(1.f);
+			if (!InputDirection.IsNearlyZero())
+				Velocity = FMath::Lerp(Velocity, InputDirection * Velocity.Size(), StepPrediction_InputInfluence);
 
-	return CalculateVectorStackValue(LegTargetLocationStackID);
+			DesiredLocation += (Velocity * PredictionTime).GetClampedToMaxSize(StepPrediction_MaxDistance);
+
+			const FVector AngularVelocity = ParentBody->GetDesiredAngularVelocity();
+			if (!AngularVelocity.IsNearlyZero())
+				DesiredRotation = FQuat(AngularVelocity.GetSafeNormal(), AngularVelocity.Size() * PredictionTime) * DesiredRotation;
+		}
+
+		CachedBasicTargetLocation = DesiredRotation.RotateVector(GetLegTargetOffset()) + DesiredLocation;
+		SetVectorSourceValue(LegTargetLocationStackID, 0, this, CachedBasicTargetLocation);
+	}
+
+	CachedTargetLocation = CalculateVectorStackValue(LegTargetLocationStackID);
 }
 
 
 // Casts a trace that finds a suitable foot location, (0, 0, 0) if failed
 FVector UMPAS_Leg::FootTrace(const FVector& StepTargetLocation)
+{
+	return FootTraceInSlot(StepTargetLocation, FootTraceSlot_Target);
+}
+
+// Finds foot location, using the given foot trace slot: requests an asynchronous trace and returns predicted location, falls back to a synchronous trace if prediction is not possible
+FVector UMPAS_Leg::FootTraceInSlot(const FVector& StepTargetLocation, int32 InSlot)
 {
 	FVector StartLocation = StepTargetLocation + GetUpVector() * MaxFootElevation;
 	FVector EndLocation = StepTargetLocation - GetUpVector() * MaxFootVerticalExtent;
 
+	// Sampling the handler's terrain cache, no trace is needed if the ground there is cached
+	// The cache stores world Z heights, so it is only used by legs, whose up vector is close to world up (within ~10 degrees)
+	float CachedHeight;
+	FVector CachedNormal;
+	if (GetHandler() && GetUpVector().Z >= 0.985f && GetHandler()->SampleTerrainCache(StepTargetLocation, CachedHeight, CachedNormal))
+	{
+		const float Elevation = CachedHeight - StepTargetLocation.Z;
+		if (Elevation <= MaxFootElevation && Elevation >= -MaxFootVerticalExtent)
+			return FVector(StepTargetLocation.X, StepTargetLocation.Y, CachedHeight);
+	}
+
+	if (!UseAsyncFootTrace || FootTraceIndex == -1 || !GetHandler() || !GetHandler()->UsesAsyncGroundQueries())
+		return FootTraceSync(StartLocation, EndLocation);
+
+	// Predicting from the latest result, if it's close enough (distance is measured in the plane, perpendicular to leg's up vector)
+	// Asynchronous trace is only requested when the prediction is used, its result will arrive next frame and will be used for the following predictions
+	// A missed result can't be predicted from, the ground could have appeared since, so it falls through to the synchronous trace
+	if (FootTrace_HasResult && FootTrace_ResultHit && FVector::VectorPlaneProject(StepTargetLocation - FootTrace_ResultLocation, GetUpVector()).Size() <= FootTracePredictionDistance)
+	{
+		// Intersecting the trace with the plane of the latest hit
+		const float Facing = FVector::DotProduct(GetUpVector(), FootTrace_ResultNormal);
+		if (Facing > KINDA_SMALL_NUMBER)
+		{
+			const float Elevation = FVector::DotProduct(FootTrace_ResultLocation - StepTargetLocation, FootTrace_ResultNormal) / Facing;
+
+			if (Elevation <= MaxFootElevation && Elevation >= -MaxFootVerticalExtent)
+			{
+				GetHandler()->RequestFootTrace(FootTraceIndex, InSlot, StartLocation, EndLocation);
+				return StepTargetLocation + GetUpVector() * Elevation;
+			}
+		}
+	}
+
+	// Prediction is not possible (no result yet, latest trace has missed, or ground is too steep / too far from the latest result)
+	return FootTraceSync(StartLocation, EndLocation);
+}
+
+// Casts a synchronous foot trace, caching it's result for future predictions, (0, 0, 0) if failed
+FVector UMPAS_Leg::FootTraceSync(const FVector& InStart, const FVector& InEnd)
+{
 	FHitResult Hit;
-	if (GetWorld()->LineTraceSingleByChannel(Hit, StartLocation, EndLocation, ECC_Visibility))
+	bool HasHit = GetHandler() ? GetHandler()->QueryGround(InStart, InEnd, Hit, ECC_Visibility) : GetWorld()->LineTraceSingleByChannel(Hit, InStart, InEnd, ECC_Visibility);
+
+	CacheFootTraceResult(InStart, HasHit ? &Hit : nullptr);
+
+	if (HasHit)
 		return Hit.Location;
 
 	// If no location was found FVector(0.f, 0.f, 0.f) is returned
@@ -242,6 +330,41 @@ FVector UMPAS_Leg::FootTrace(const FVector& StepTargetLocation)
 		return FVector(0, 0, 0);
 }
 
+// Caches the result of a foot trace for future predictions
+void UMPAS_Leg::CacheFootTraceResult(const FVector& InStart, const FHitResult* InHit)
+{
+	FootTrace_HasResult = true;
+	FootTrace_ResultHit = InHit != nullptr;
+
+	if (InHit)
+	{
+		FootTrace_ResultLocation = InHit->Location;
+		FootTrace_ResultNormal = InHit->ImpactNormal;
+	}
+
+	else
+	{
+		FootTrace_ResultLocation = InStart;
+		FootTrace_ResultNormal = GetUpVector();
+	}
+}
+
+// CALLED BY THE HANDLER : Receives the result of an asynchronous foot trace, requested in the given slot (InHit is nullptr if nothing was hit)
+void UMPAS_Leg::OnFootTraceCompleted(int32 InSlot, const FVector& InStart, const FVector& InEnd, const FHitResult* InHit)
+{
+	CacheFootTraceResult(InStart, InHit);
+
+	// Refining the target of the current step, which was started from a prediction
+	if (InSlot == FootTraceSlot_Step && IsMoving && InHit && InStart.Equals(FootTrace_StepTraceStart))
+	{
+		StepAnimationTargetLocation = InHit->Location;
+		StepDistance = FVector::Distance(StepAnimationStartLocation, StepAnimationTargetLocation);
+
+		if (UseNativeStepAnimation)
+			GetHandler()->RetargetStep(ActiveStepIndex, StepAnimationTargetLocation, CalculateResultingStepHeight());
+	}
+}
+
 
 // Checks whether the leg should make a step
 bool UMPAS_Leg::ShouldStep()
@@ -260,15 +383,7 @@ bool UMPAS_Leg::ShouldStep()
 // CALLED BY THE HANDLER :  Called when a subscribed-to parameter is changed
 void UMPAS_Leg::OnParameterChanged(FName InParameterName)
 {
-	if (InParameterName == "CurrentLegGroup")
-	{
-		HasMovedInCurrentWindow = false;
-		if (WaitingOnLegGroup)
-			if (Handler->GetIntParameter(InParameterName) == LegGroup)
-				StartStepAnimation();
-	}
-
-	else if (InParameterName == "INTENTION_LEGS_StepLengthMultiplier")
+	if (InParameterName == "INTENTION_LEGS_StepLengthMultiplier")
 		StepLengthMultiplier = GetHandler()->GetFloatParameter(InParameterName);
 
 	else if (InParameterName == "INTENTION_LEGS_StepTriggerDistanceMultiplier")
@@ -282,7 +397,17 @@ void UMPAS_Leg::OnParameterChanged(FName InParameterName)
 }
 
 
-// Starts the step animation timeline
+// CALLED BY THE GAIT SCHEDULER : The group (or the swing window in PhaseOscillator mode) of this leg has become active
+void UMPAS_Leg::OnLegGroupActivated()
+{
+	HasMovedInCurrentWindow = false;
+
+	if (WaitingOnLegGroup)
+		StartStepAnimation();
+}
+
+
+// Starts the step animation (natively animated by the handler if UseNativeStepAnimation is set, otherwise by the step timeline)
 void UMPAS_Leg::StartStepAnimation()
 {
 	WaitingOnLegGroup = false;
@@ -298,7 +423,8 @@ void UMPAS_Leg::StartStepAnimation()
 	float MaxStepLength = StepLength * StepLengthMultiplier * SpeedMultiplier;
 
 	FVector AdjustedFootTraceLocation = StepDirection * FMath::Min(StepVector.Size(), MaxStepLength) + GetComponentLocation();
-	StepAnimationTargetLocation = FootTrace(AdjustedFootTraceLocation);
+	FootTrace_StepTraceStart = AdjustedFootTraceLocation + GetUpVector() * MaxFootElevation;
+	StepAnimationTargetLocation = FootTraceInSlot(AdjustedFootTraceLocation, FootTraceSlot_Step);
 
 	StepDistance = FVector::Distance(StepAnimationStartLocation, StepAnimationTargetLocation);
 
@@ -311,9 +437,31 @@ void UMPAS_Leg::StartStepAnimation()
 	else
 	{
 		ValidPlacement = true;
-		GetHandler()->SetIntParameter("CurrentlyMovingLegsCount", GetHandler()->GetIntParameter("CurrentlyMovingLegsCount") + 1);
-		GetHandler()->TimerController->SetTimelinePlaybackSpeed(StepTimelineName, AnimationSpeedMultiplier * SpeedMultiplier);
-		GetHandler()->TimerController->StartTimeline(StepTimelineName);
+		GetHandler()->NotifyLegStepStarted();
+
+		if (UseNativeStepAnimation)
+		{
+			FMPAS_ActiveStep Step;
+			Step.Leg = this;
+			Step.StartLocation = StepAnimationStartLocation;
+			Step.TargetLocation = StepAnimationTargetLocation;
+			Step.UpVector = GetUpVector();
+			Step.StepHeight = CalculateResultingStepHeight();
+			Step.Duration = FMath::Max(StepAnimationDuration, KINDA_SMALL_NUMBER);
+			Step.PlaybackSpeed = AnimationSpeedMultiplier * SpeedMultiplier;
+			Step.FinishNotifyTime = FMath::Clamp(StepAnimationDuration - StepFinishTimeOffset, 0.f, Step.Duration);
+			Step.HeightCurve = StepHeightCurveIndex;
+			Step.ExtentCurve = StepExtentCurveIndex;
+
+			ActiveStepIndex = GetHandler()->StartStep(Step);
+		}
+
+		else
+		{
+			GetHandler()->TimerController->SetTimelinePlaybackSpeed(StepTimelineName, AnimationSpeedMultiplier * SpeedMultiplier);
+			GetHandler()->TimerController->StartTimeline(StepTimelineName);
+		}
+
 		IsMoving = true;
 		HasMovedInCurrentWindow = true;
 	}
@@ -333,15 +481,38 @@ void UMPAS_Leg::OnStepAnimationTimelineUpdated(FName InTimelineName, float Curre
 		if (StepAnimationHeightCurve)
 			HeightFactor = StepAnimationHeightCurve->GetFloatValue(CurrentTime / StepAnimationDuration);
 
-		float ResultingStepHeight = StepHeight * (0.5 + (StepDistance / (StepLength * StepLengthMultiplier)) / 2);
-		if (StepHeightScalingCurve)
-			ResultingStepHeight = StepHeight * StepHeightScalingCurve->GetFloatValue(StepDistance / (StepLength * StepLengthMultiplier));
-
-		FVector NewLocation = FMath::Lerp(StepAnimationStartLocation, StepAnimationTargetLocation, ExtentFactor) + GetUpVector() * ResultingStepHeight * HeightFactor;
+		FVector NewLocation = FMath::Lerp(StepAnimationStartLocation, StepAnimationTargetLocation, ExtentFactor) + GetUpVector() * CalculateResultingStepHeight() * HeightFactor;
 		SetVectorSourceValue(0, SelfAbsoluteLocationLayerID, this, NewLocation);
 	}
 }
 
+// Peak height of the current step, scaled by the step distance
+float UMPAS_Leg::CalculateResultingStepHeight()
+{
+	const float DistanceRatio = StepDistance / (StepLength * StepLengthMultiplier);
+
+	if (StepHeightScalingCurveIndex != -1)
+		return StepHeight * GetHandler()->SampleBakedCurve(StepHeightScalingCurveIndex, DistanceRatio);
+
+	if (StepHeightScalingCurve)
+		return StepHeight * StepHeightScalingCurve->GetFloatValue(DistanceRatio);
+
+	return StepHeight * (0.5 + DistanceRatio / 2);
+}
+
+// CALLED BY THE HANDLER : Moves the foot to the given location of the step animation
+void UMPAS_Leg::SetStepAnimationLocation(const FVector& InLocation)
+{
+	SetVectorSourceValue(0, SelfAbsoluteLocationLayerID, this, InLocation);
+}
+
+// CALLED BY THE HANDLER : The step animation has finished
+void UMPAS_Leg::OnStepAnimationFinished()
+{
+	IsMoving = false;
+	ActiveStepIndex = -1;
+}
+
 // CALLED BY THE HANDLER :  Called when a subscribed-to timeline is finished
 void UMPAS_Leg::OnStepAnimationTimelineFinished(FName InTimelineName)
 {
@@ -355,27 +526,7 @@ void UMPAS_Leg::OnStepAnimationTimelineFinished(FName InTimelineName)
 void UMPAS_Leg::OnStepAnimationTimelineNotify(FName InTimelineName, FName InNotifyName)
 {
 	if (InTimelineName == StepTimelineName && InNotifyName == "StepFinishedNotify")
-	{
-		int32 CurrentlyMovingLegsCount = GetHandler()->GetIntParameter("CurrentlyMovingLegsCount");
-		GetHandler()->SetIntParameter("CurrentlyMovingLegsCount", CurrentlyMovingLegsCount - 1);
-
-		if (CurrentlyMovingLegsCount - 1 == 0)
-		{
-			int32 CurrentLegGroup = GetHandler()->GetIntParameter("CurrentLegGroup");
-
-			if (CurrentLegGroup == GetHandler()->GetIntParameter("MaxLegGroupID"))
-				CurrentLegGroup = 0;
-
-			else
-				CurrentLegGroup++;
-
-			// Skiping empty leg groups
-			while (!GetHandler()->IsIntParameterValid(FName("LegGroupSize_" + FString::FromInt(CurrentLegGroup))))
-				CurrentLegGroup++;
-
-			GetHandler()->SetIntParameter("CurrentLegGroup", CurrentLegGroup);
-		}
-	}
+		GetHandler()->NotifyLegStepFinished();
 }
 
 
@@ -385,6 +536,7 @@ void UMPAS_Leg::SetStepFinishTimeOffset(float newOffset)
 {
 	StepFinishTimeOffset = newOffset;
 
-	// Updating value in the timeline
-	GetHandler()->TimerController->ModifyTimelineNotify(StepTimelineName, "StepFinishedNotify", StepAnimationDuration - StepFinishTimeOffset);
+	// Updating value in the timeline (native step animation reads the offset when the next step starts)
+	if (!UseNativeStepAnimation)
+		GetHandler()->TimerController->ModifyTimelineNotify(StepTimelineName, "StepFinishedNotify", StepAnimationDuration - StepFinishTimeOffset);
 }
\ No newline at end of file
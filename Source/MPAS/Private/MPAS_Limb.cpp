@@ -4,6 +4,7 @@
 #include "Default/RigElements/MPAS_Limb.h"
 #include "MPAS_Handler.h"
 #include "Engine/SkeletalMesh.h"
+#include "AnimationRuntime.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Kismet/KismetStringLibrary.h"
 
@@ -67,45 +68,53 @@ void UMPAS_Limb::InitLimb()
             Segments.Empty();
             CurrentState.Empty();
 
-            // Fetching the bone chain (in reverse order, because you can only get bone's parent and not children)
-            TArray<FName> ReversedBoneChain;
+            // Bone chain data is shared between all limbs, fetching the same chain from the same mesh
+            TSharedPtr<const FMPAS_LimbFetchedChain> Chain = GetFetchedChain(Fetch_MeshComponent->GetSkeletalMeshAsset(), Fetch_OriginBone, Fetch_TipBone);
+            if (!Chain.IsValid())
+                return;
 
-            FName Bone = Fetch_TipBone;
-            while (Fetch_MeshComponent->GetBoneIndex(Bone) != INDEX_NONE)
-            {
-                ReversedBoneChain.Add(Bone);
+            const FTransform& L_ComponentTransform = Fetch_MeshComponent->GetComponentTransform();
 
-                if (Bone == Fetch_OriginBone)
-                    break;
+            // Using rest pose if the mesh has not been posed yet
+            const bool L_UseRestPose = Fetch_MeshComponent->GetComponentSpaceTransforms().Num() == 0;
 
-                Bone = Fetch_MeshComponent->GetParentBone(Bone);
-            }
+            Segments.Reserve(Chain->SegmentOffsets.Num());
+            CurrentState.Reserve(Chain->BoneIndices.Num());
 
-            // Processing bone chain to generate segments and initial state
-            for (int32 i = ReversedBoneChain.Num() - 1; i > 0; i--)
+            // Generating segments and initial state
+            for (int32 i = 0; i < Chain->BoneIndices.Num(); i++)
             {
-                FMPAS_LimbSegmentData NewSegment;
                 FMPAS_LimbSegmentState NewState;
 
-                NewState.Location = Fetch_MeshComponent->GetBoneLocation(ReversedBoneChain[i]);
-                NewState.Rotation = (FRotator)Fetch_MeshComponent->GetBoneQuaternion(ReversedBoneChain[i]);
+                if (L_UseRestPose)
+                {
+                    NewState.Location = L_ComponentTransform.TransformPosition(Chain->RestLocations[i]);
+                    NewState.Rotation = (FRotator)L_ComponentTransform.TransformRotation(Chain->RestRotations[i]);
+                }
+
+                else
+                {
+                    const FTransform L_BoneTransform = Fetch_MeshComponent->GetBoneTransform(Chain->BoneIndices[i]);
+                    NewState.Location = L_BoneTransform.GetLocation();
+                    NewState.Rotation = (FRotator)L_BoneTransform.GetRotation();
+                }
 
-                NewSegment.BoneName = ReversedBoneChain[i];
-                NewSegment.Length = (NewState.Location - Fetch_MeshComponent->GetBoneLocation(ReversedBoneChain[i - 1])).Size();
-                
-                MaxExtent += NewSegment.Length;
-                
-                Segments.Add(NewSegment);
                 CurrentState.Add(NewState);
-            }
 
-            // Tip bone state
-            FMPAS_LimbSegmentState TipBoneState;
+                // The tip bone doesn't have a segment
+                if (i < Chain->SegmentOffsets.Num())
+                {
+                    FMPAS_LimbSegmentData NewSegment;
 
-            TipBoneState.Location = Fetch_MeshComponent->GetBoneLocation(ReversedBoneChain[0]);
-            TipBoneState.Rotation = (FRotator)Fetch_MeshComponent->GetBoneQuaternion(ReversedBoneChain[0]);
+                    // Offsets are transformed as vectors, so non-uniform component scale stretches each segment along it's own direction
+                    NewSegment.BoneName = Chain->BoneNames[i];
+                    NewSegment.Length = L_ComponentTransform.TransformVector(Chain->SegmentOffsets[i]).Size();
 
-            CurrentState.Add(TipBoneState);
+                    MaxExtent += NewSegment.Length;
+
+                    Segments.Add(NewSegment);
+                }
+            }
 
             // Fetching origin position if needed
             if (Fetch_OriginPosition)
@@ -125,90 +134,106 @@ void UMPAS_Limb::InitLimb()
     if (AdditionalSegmentData.Num() > 0)
         for (int i = 0; i < Segments.Num(); i++)
         {
+            Segments[i].AngularLimitModel = AdditionalSegmentData[UKismetMathLibrary::Clamp(i, 0, AdditionalSegmentData.Num() - 1)].AngularLimitModel;
             Segments[i].AngularLimits_Min = AdditionalSegmentData[UKismetMathLibrary::Clamp(i, 0, AdditionalSegmentData.Num() - 1)].AngularLimits_Min;
             Segments[i].AngularLimits_Max = AdditionalSegmentData[UKismetMathLibrary::Clamp(i, 0, AdditionalSegmentData.Num() - 1)].AngularLimits_Max;
+            Segments[i].SwingLimit = AdditionalSegmentData[UKismetMathLibrary::Clamp(i, 0, AdditionalSegmentData.Num() - 1)].SwingLimit;
+            Segments[i].TwistLimit_Min = AdditionalSegmentData[UKismetMathLibrary::Clamp(i, 0, AdditionalSegmentData.Num() - 1)].TwistLimit_Min;
+            Segments[i].TwistLimit_Max = AdditionalSegmentData[UKismetMathLibrary::Clamp(i, 0, AdditionalSegmentData.Num() - 1)].TwistLimit_Max;
             Segments[i].SegmentMeshExtent = AdditionalSegmentData[UKismetMathLibrary::Clamp(i, 0, AdditionalSegmentData.Num() - 1)].SegmentMeshExtent;
         }
 
+    // Caching swing-twist limit values for the solvers
+    for (FMPAS_LimbSegmentData& Segment : Segments)
+        Segment.CacheSwingTwistLimits();
+
+    // Selecting solvers, specialized for this segment count
+    SolverKernels = SelectSolverKernels(Segments.Num());
+
     // Fillin out target state with a default value of the initial state
     TargetState = CurrentState;
+
+    // Precomputing poses for the warm-start lookup
+    if (EnableWarmStartLookup && Initialized)
+        RebuildWarmStartLookup();
 }
 
 
-// Solves the limb by applying the specified algorithm to the segments
-void UMPAS_Limb::SolveLimb()
+// Gathers solve inputs during the rig update, the limb is marked for dispatch if they don't match the cached solution
+void UMPAS_Limb::PrepareSolve()
 {
-    if (!CurrentlySolving)
-    {
-        CurrentlySolving = true;
+    if (CurrentlySolving)
+        return;
 
-        // Data that is going to be passed to the background thread
-        EMPAS_LimbSolvingAlgorithm L_Algorithm = Algoritm;
-        TArray<FMPAS_LimbSegmentData> L_Segments = Segments;
-        TArray<FMPAS_LimbSegmentState> L_State = TargetState;
+    // Origin, target, up vector and pole targets
+    GatherSolveInput(SolveInput);
 
-        float L_LimbMaxExtent = MaxExtent;
+    // Nothing has changed since the last converged solution, so the target state is still valid
+    if (IsSolveCached(Algoritm, SolveInput))
+    {
+        FramesSinceLastSolve = 0;
+        return;
+    }
 
-        const int32 L_MaxIterations = IK_MaxIterations;
-        const float L_Tollerance = IK_ErrorTollerance;
-        const FVector L_UpVector = GetUpVector();
+    SolvePending = true;
+}
 
-        const bool L_EnableRollRecalculation = EnableRollRecalculation;
-        const float L_LimbRoll = LimbRoll;
+// CALLED BY THE HANDLER : Solves the limb, if PrepareSolve has marked it during the rig update (after the handler has distributed the iteration budget)
+void UMPAS_Limb::DispatchPendingSolve()
+{
+    if (!SolvePending)
+        return;
 
-        FVector OriginLocation = GetComponentLocation();
-        FVector TargetLocation = GetLimbTarget();
+    SolvePending = false;
+    SolveLimb();
+}
+
+// Solves the limb by applying the specified algorithm to the segments (inputs are gathered by PrepareSolve)
+void UMPAS_Limb::SolveLimb()
+{
+    if (!CurrentlySolving)
+    {
+        // Iteration budget, granted by the handler (negative value means that the limb is not limited by the budget)
+        const int32 L_MaxIterations = GrantedIterations < 0 ? IK_MaxIterations : FMath::Min(IK_MaxIterations, GrantedIterations);
 
-        // Pole target calclulation
-        TArray<FVector> L_PoleTargets;
+        // Solves, that were cut short by the budget, are always continued from where they have stopped
+        const bool L_WarmStart = IK_EnableWarmStart || LastSolveBudgetLimited;
 
-        // Base value just to make sure there always is at least some kind of a pole target
-        FVector LastCalculatedPoleTarget = (OriginLocation + TargetLocation) / 2 + GetUpVector() * 10000;
-        
-        for (int32 i = 0; i < Segments.Num(); i++)
+        // The handler has not granted any iterations this update, keeping the last pose
+        if (L_MaxIterations <= 0 && UsesIterativeSolver())
         {
-            const FMPAS_LimbSegmentData& Seg = Segments[i];
-            if (PoleTargets.Contains(i))
-                LastCalculatedPoleTarget = CalculatePoleTargetLocation(PoleTargets[i]);
-            
-            L_PoleTargets.Add(LastCalculatedPoleTarget);
-            //L_PoleTargets.Add(FVector(0, 0, 0));
+            FramesSinceLastSolve++;
+            return;
         }
-        
+
+        CurrentlySolving = true;
+        FramesSinceLastSolve = 0;
+        LastSolveBudgetLimited = L_MaxIterations < IK_MaxIterations;
+
+        // Data that is going to be passed to the background thread
+        const FMPAS_LimbSolveTask L_Task = MakeSolveTask(L_MaxIterations, L_WarmStart);
+
+        // Remembering solve inputs to compare against them on the next update
+        LastSolvedAlgorithm = Algoritm;
+        LastSolveInput = SolveInput;
+        LastSolveEnableRollRecalculation = EnableRollRecalculation;
+        LastSolveRollRecalculationMode = RollRecalculationMode;
+        LastSolveLimbRoll = LimbRoll;
 
         if (EnableAsyncCalculation)
         {
-            // Calling the necessary algorithm on a background thread, so it doesn't waste the perfomance of the main one
-            AsyncTask( ENamedThreads::AnyBackgroundThreadNormalTask, [L_Algorithm, L_Segments, L_State, OriginLocation, TargetLocation, L_PoleTargets, L_MaxIterations, L_Tollerance, L_UpVector, L_EnableRollRecalculation, L_LimbRoll, L_LimbMaxExtent, this] ()
+            // Calling the solver on a background thread, so it doesn't waste the perfomance of the main one
+            AsyncTask( ENamedThreads::AnyBackgroundThreadNormalTask, [L_Task, this] ()
             {
-                // New state declaration
-                TArray<FMPAS_LimbSegmentState> NewState;
-
-                // Selecting an algorithm and calling solving 
-                switch (L_Algorithm)
-                {
-                case EMPAS_LimbSolvingAlgorithm::FABRIK_IK: NewState = Solve_FABRIK_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_MaxIterations, L_Tollerance); break;
-                case EMPAS_LimbSolvingAlgorithm::FABRIK_Limited_IK: NewState = Solve_FABRIK_Limited_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_MaxIterations, L_Tollerance); break;
-                case EMPAS_LimbSolvingAlgorithm::CCD_IK: NewState = Solve_CCD_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_MaxIterations, L_Tollerance); break;
-                case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_IK: NewState = Solve_PoleFABRIK_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_PoleTargets, L_MaxIterations, L_Tollerance, L_UpVector); break;
-                case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_Limited_IK: NewState = Solve_PoleFABRIK_Limited_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_PoleTargets, L_MaxIterations, L_Tollerance, L_UpVector); break;
-                case EMPAS_LimbSolvingAlgorithm::PistonMulti: NewState = Solve_Piston_Multi(OriginLocation, TargetLocation, L_Segments, L_State, L_LimbMaxExtent); break;
-                case EMPAS_LimbSolvingAlgorithm::PistonSequential: NewState = Solve_Piston_Sequential(OriginLocation, TargetLocation, L_Segments, L_State); break;
-                case EMPAS_LimbSolvingAlgorithm::RotateToTarget: NewState = Solve_RotateToTarget(OriginLocation, TargetLocation, L_Segments, L_State); break;
-
-                //case EMPAS_LimbSolvingAlgorithm::Gauss_Seidel: NewState = Solve_Gauss_Seidel_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_PoleTargets, L_MaxIterations, L_Tollerance, L_UpVector); break;
-
-                default: break;
-                }
-
-                // Recalculating segment roll
-                if (L_EnableRollRecalculation)
-                    RecalculateRoll(NewState, L_LimbRoll, OriginLocation, TargetLocation, L_Segments, L_PoleTargets, L_UpVector);
+                bool Converged = false;
+                int32 Iterations = 0;
+                float Error = 0.f;
+                TArray<FMPAS_LimbSegmentState> NewState = L_Task(Converged, Iterations, Error);
 
                 // Calling back to the game thread, notifyinh the limb of the results
-                AsyncTask( ENamedThreads::GameThread, [NewState, this] ()
+                AsyncTask( ENamedThreads::GameThread, [NewState, Converged, Iterations, Error, this] ()
                 {
-                    FinishSolving(NewState);
+                    FinishSolving(NewState, Converged, Iterations, Error);
                 });
             });
         }
@@ -216,41 +241,287 @@ void UMPAS_Limb::SolveLimb()
         // Non async calculation to leave users with more options
         else
         {
-            // New state declaration
-            TArray<FMPAS_LimbSegmentState> NewState;
+            bool Converged = false;
+            int32 Iterations = 0;
+            float Error = 0.f;
+            TArray<FMPAS_LimbSegmentState> NewState = L_Task(Converged, Iterations, Error);
 
-            // Selecting an algorithm and calling solving 
-            switch (L_Algorithm)
-            {
-            case EMPAS_LimbSolvingAlgorithm::FABRIK_IK: NewState = Solve_FABRIK_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_MaxIterations, L_Tollerance); break;
-            case EMPAS_LimbSolvingAlgorithm::FABRIK_Limited_IK: NewState = Solve_FABRIK_Limited_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_MaxIterations, L_Tollerance); break;
-            case EMPAS_LimbSolvingAlgorithm::CCD_IK: NewState = Solve_CCD_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_MaxIterations, L_Tollerance); break;
-            case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_IK: NewState = Solve_PoleFABRIK_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_PoleTargets, L_MaxIterations, L_Tollerance, L_UpVector); break;
-            case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_Limited_IK: NewState = Solve_PoleFABRIK_Limited_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_PoleTargets, L_MaxIterations, L_Tollerance, L_UpVector); break;
-            case EMPAS_LimbSolvingAlgorithm::PistonMulti: NewState = Solve_Piston_Multi(OriginLocation, TargetLocation, L_Segments, L_State, L_LimbMaxExtent); break;
-            case EMPAS_LimbSolvingAlgorithm::PistonSequential: NewState = Solve_Piston_Sequential(OriginLocation, TargetLocation, L_Segments, L_State); break;
-            case EMPAS_LimbSolvingAlgorithm::RotateToTarget: NewState = Solve_RotateToTarget(OriginLocation, TargetLocation, L_Segments, L_State); break;
-
-            //case EMPAS_LimbSolvingAlgorithm::Gauss_Seidel: NewState = Solve_Gauss_Seidel_IK(OriginLocation, TargetLocation, L_Segments, L_State, L_PoleTargets, L_MaxIterations, L_Tollerance, L_UpVector); break;
-
-            default: break;
-            }
-
-            // Recalculating segment roll
-            if (L_EnableRollRecalculation)
-                RecalculateRoll(NewState, L_LimbRoll, OriginLocation, TargetLocation, L_Segments, L_PoleTargets, L_UpVector);
+            FinishSolving(NewState, Converged, Iterations, Error);
+        }
+    }
+}
 
-            FinishSolving(NewState);
+// Copies the data the solve needs and wraps the solver into a task (called by SolveLimb, before the solve inputs are remembered)
+FMPAS_LimbSolveTask UMPAS_Limb::MakeSolveTask(int32 InMaxIterations, bool InWarmStart)
+{
+    const EMPAS_LimbSolvingAlgorithm L_Algorithm = Algoritm;
+    const float L_LimbMaxExtent = MaxExtent;
+    const int32 L_MaxIterations = InMaxIterations;
+    const float L_Tollerance = IK_ErrorTollerance;
+    bool L_WarmStart = InWarmStart;
+
+    const bool L_EnableRollRecalculation = EnableRollRecalculation;
+    const float L_LimbRoll = LimbRoll;
+    const EMPAS_LimbRollRecalculationMode L_RollRecalculationMode = RollRecalculationMode;
+
+    const FMPAS_LimbSolverKernels L_Kernels = SolverKernels;
+    const FMPAS_LimbSolveInput L_Input = SolveInput;
+
+    // Whether the target has moved far (relative to the origin) since the last solve, so the previous solution is a poor starting point
+    const bool L_TargetJumped = !HasCachedSolution ||
+        ((SolveInput.TargetLocation - SolveInput.OriginLocation) - (LastSolveInput.TargetLocation - LastSolveInput.OriginLocation)).SizeSquared() > WarmStartLookup_JumpDistance * WarmStartLookup_JumpDistance;
+
+    // Copied only once it is known that the limb is going to be solved
+    TArray<FMPAS_LimbSegmentData> L_Segments = Segments;
+    TArray<FMPAS_LimbSegmentState> L_State = TargetState;
+
+    // Seeding the solver with a precomputed pose after a big target jump
+    // Lookup poses know nothing about pole targets, so pole based algorithms keep seeding from their poles
+    if (EnableWarmStartLookup && L_TargetJumped && IsIterativeAlgorithm(L_Algorithm) && !IsPoleSeededAlgorithm(L_Algorithm) && WarmStartLookup.SegmentNum == Segments.Num())
+    {
+        const int32 L_Cell = WarmStartLookup.GetCellIndex(SolveInput.TargetLocation - SolveInput.OriginLocation);
+        if (L_Cell != -1)
+        {
+            ApplyWarmStartPose(WarmStartLookup, L_Cell, SolveInput.OriginLocation, L_Segments, L_State);
+            L_WarmStart = true;
         }
     }
+
+    return [L_Algorithm, L_Input, L_Segments, L_State, L_MaxIterations, L_Tollerance, L_WarmStart, L_EnableRollRecalculation, L_LimbRoll, L_RollRecalculationMode, L_LimbMaxExtent, L_Kernels] (bool& OutConverged, int32& OutIterations, float& OutError)
+    {
+        return ExecuteSolvingAlgorithm(L_Algorithm, L_Input, L_Segments, L_State, L_MaxIterations, L_Tollerance, L_LimbMaxExtent, L_WarmStart, L_EnableRollRecalculation, L_LimbRoll, L_RollRecalculationMode, L_Kernels, OutConverged, OutIterations, OutError);
+    };
 }
 
 // A call back from the background thread, that indicates that the limb has finished solving it's state
-void UMPAS_Limb::FinishSolving(TArray<FMPAS_LimbSegmentState> ResultingState)
+void UMPAS_Limb::FinishSolving(TArray<FMPAS_LimbSegmentState> ResultingState, bool InConverged, int32 InIterations, float InError)
 {
     CurrentlySolving = false;
 
+    // The limb has been reinitialized while solving, the result does not match the segments anymore
+    if (ResultingState.Num() != CurrentState.Num())
+        return;
+
     TargetState = ResultingState;
+
+    // Keeping segments clear of the environment, the corrected state also seeds the next solve
+    if (EnableClearanceConstraint)
+    {
+        UncorrectedTargetState = ResultingState;
+        ClearanceDirty = false;
+
+        if (ClearanceCorrections.Num() == Segments.Num() && TargetState.Num() == Segments.Num() + 1)
+            ApplyClearanceCorrections(TargetState, Segments, ClearanceCorrections);
+    }
+
+    // Caching target rotations as quaternions for the spring interpolation (kept regardless of the mode, so it could be switched at runtime)
+    TargetRotations.SetNum(TargetState.Num(), EAllowShrinking::No);
+    for (int32 i = 0; i < TargetState.Num(); i++)
+        TargetRotations[i] = TargetState[i].Rotation.Quaternion();
+
+    HasCachedSolution = true;
+    LastSolveConverged = InConverged;
+
+    LastSolveIterations = InIterations;
+    LastSolveError = InError;
+}
+
+// Forces the limb to solve on the next update, even if its inputs have not changed (call after modifying Segments or solver settings at runtime)
+void UMPAS_Limb::InvalidateSolveCache()
+{
+    HasCachedSolution = false;
+
+    // Segment limits might have been changed as well
+    for (FMPAS_LimbSegmentData& Segment : Segments)
+        Segment.CacheSwingTwistLimits();
+}
+
+// Whether the given solve inputs match the inputs of the last converged solution (within SolveCache_Tollerance)
+bool UMPAS_Limb::IsSolveCached(EMPAS_LimbSolvingAlgorithm InAlgorithm, const FMPAS_LimbSolveInput& InInput) const
+{
+    // Unconverged solutions are never cached, so the solver could keep iterating towards the target
+    if (!EnableSolveCaching || !HasCachedSolution || !LastSolveConverged)
+        return false;
+
+    // Clearance corrections have changed and have to be applied to the solution
+    if (EnableClearanceConstraint && ClearanceDirty)
+        return false;
+
+    if (InAlgorithm != LastSolvedAlgorithm)
+        return false;
+
+    // Roll is recalculated as a part of the solve
+    if (EnableRollRecalculation != LastSolveEnableRollRecalculation || RollRecalculationMode != LastSolveRollRecalculationMode || LimbRoll != LastSolveLimbRoll)
+        return false;
+
+    return InInput.Equals(LastSolveInput, SolveCache_Tollerance);
+}
+
+// Returns bone chain data between the given bones of the mesh, extracted once per mesh and bone pair and shared by all limbs (nullptr if the chain can't be fetched)
+TSharedPtr<const FMPAS_LimbFetchedChain> UMPAS_Limb::GetFetchedChain(USkeletalMesh* InMesh, FName InOriginBone, FName InTipBone)
+{
+    if (!InMesh)
+        return nullptr;
+
+    // Only accessed from the game thread (during limb initialization)
+    static TMap<TTuple<TObjectKey<USkeletalMesh>, FName, FName>, TSharedPtr<const FMPAS_LimbFetchedChain>> ChainCache;
+
+    const FReferenceSkeleton& RefSkeleton = InMesh->GetRefSkeleton();
+
+    // Destroyed meshes are evicted once the cache has doubled since the last eviction, so misses don't scan the whole cache
+    static int32 EvictionThreshold = 16;
+
+    // The mesh could have been reimported or edited since the chain was cached (object key stays the same), so the cached chain is validated against the current reference skeleton
+    const TTuple<TObjectKey<USkeletalMesh>, FName, FName> Key(InMesh, InOriginBone, InTipBone);
+    if (const TSharedPtr<const FMPAS_LimbFetchedChain>* CachedChain = ChainCache.Find(Key))
+    {
+        if (IsFetchedChainValid(**CachedChain, RefSkeleton))
+            return *CachedChain;
+
+        ChainCache.Remove(Key);
+    }
+
+    // Evicting chains of destroyed meshes
+    if (ChainCache.Num() >= EvictionThreshold)
+    {
+        for (auto It = ChainCache.CreateIterator(); It; ++It)
+            if (!It.Key().Get<0>().ResolveObjectPtr())
+                It.RemoveCurrent();
+
+        EvictionThreshold = FMath::Max(16, ChainCache.Num() * 2);
+    }
+
+    // Fetching the bone chain (in reverse order, because you can only get bone's parent and not children)
+    TArray<int32> ReversedBoneChain;
+
+    int32 BoneIndex = RefSkeleton.FindBoneIndex(InTipBone);
+    while (BoneIndex != INDEX_NONE)
+    {
+        ReversedBoneChain.Add(BoneIndex);
+
+        if (RefSkeleton.GetBoneName(BoneIndex) == InOriginBone)
+            break;
+
+        BoneIndex = RefSkeleton.GetParentIndex(BoneIndex);
+    }
+
+    if (ReversedBoneChain.Num() == 0)
+        return nullptr;
+
+    TSharedPtr<FMPAS_LimbFetchedChain> Chain = MakeShared<FMPAS_LimbFetchedChain>();
+
+    const TArray<FTransform>& RefBonePose = RefSkeleton.GetRefBonePose();
+
+    for (int32 i = ReversedBoneChain.Num() - 1; i >= 0; i--)
+    {
+        const int32 L_BoneIndex = ReversedBoneChain[i];
+        const FTransform L_RestTransform = FAnimationRuntime::GetComponentSpaceTransformRefPose(RefSkeleton, L_BoneIndex);
+
+        Chain->BoneIndices.Add(L_BoneIndex);
+        Chain->BoneNames.Add(RefSkeleton.GetBoneName(L_BoneIndex));
+        Chain->RestLocations.Add(L_RestTransform.GetLocation());
+        Chain->RestRotations.Add(L_RestTransform.GetRotation());
+        Chain->LocalRestTransforms.Add(RefBonePose[L_BoneIndex]);
+    }
+
+    // Segment offset is the component space offset to the next bone in the chain
+    for (int32 i = 0; i < Chain->RestLocations.Num() - 1; i++)
+        Chain->SegmentOffsets.Add(Chain->RestLocations[i + 1] - Chain->RestLocations[i]);
+
+    ChainCache.Add(Key, Chain);
+
+    return Chain;
+}
+
+// Whether the cached chain still matches the given reference skeleton (bone indices, names and reference pose)
+bool UMPAS_Limb::IsFetchedChainValid(const FMPAS_LimbFetchedChain& InChain, const FReferenceSkeleton& InRefSkeleton)
+{
+    const TArray<FTransform>& RefBonePose = InRefSkeleton.GetRefBonePose();
+
+    // Only the entries at the cached indices are compared, so a hit doesn't walk the hierarchy
+    for (int32 i = 0; i < InChain.BoneIndices.Num(); i++)
+    {
+        const int32 L_BoneIndex = InChain.BoneIndices[i];
+
+        if (!RefBonePose.IsValidIndex(L_BoneIndex) || InRefSkeleton.GetBoneName(L_BoneIndex) != InChain.BoneNames[i])
+            return false;
+
+        if (!RefBonePose[L_BoneIndex].Equals(InChain.LocalRestTransforms[i]))
+            return false;
+    }
+
+#if WITH_EDITOR
+    // Bones above the chain can only be edited in the editor (by a reimport), changing the component space pose of the chain
+    for (int32 i = 0; i < InChain.BoneIndices.Num(); i++)
+    {
+        const FTransform L_RestTransform = FAnimationRuntime::GetComponentSpaceTransformRefPose(InRefSkeleton, InChain.BoneIndices[i]);
+        if (!L_RestTransform.GetLocation().Equals(InChain.RestLocations[i]) || !L_RestTransform.GetRotation().Equals(InChain.RestRotations[i]))
+            return false;
+    }
+#endif
+
+    return true;
+}
+
+// Whether the given point (World Space) can be reached by the limb (uses the warm-start lookup if it is built, otherwise only checks limb's max extent)
+bool UMPAS_Limb::IsTargetReachable(FVector InTarget)
+{
+    const FVector L_LocalTarget = InTarget - GetComponentLocation();
+
+    if (!WarmStartLookup.IsValid() || WarmStartLookup.SegmentNum != Segments.Num())
+        return L_LocalTarget.SizeSquared() <= MaxExtent * MaxExtent;
+
+    // Cells are coarse, so a reachable cell can still contain points beyond the max extent
+    const int32 L_Cell = WarmStartLookup.GetCellIndex(L_LocalTarget);
+    return L_Cell != -1 && WarmStartLookup.Reachable[L_Cell] && L_LocalTarget.SizeSquared() <= MaxExtent * MaxExtent;
+}
+
+// Rebuilds the warm-start lookup on a background thread (call after modifying Segments at runtime, if EnableWarmStartLookup is set to True)
+void UMPAS_Limb::RebuildWarmStartLookup()
+{
+    const int32 L_Version = ++WarmStartLookupVersion;
+
+    // Data that is going to be passed to the background thread
+    const TArray<FMPAS_LimbSegmentData> L_Segments = Segments;
+    const float L_LimbMaxExtent = MaxExtent;
+    const int32 L_Resolution = FMath::Clamp(WarmStartLookup_Resolution, 2, 32);
+    const bool L_ApplyAngularLimits = IsLimitedAlgorithm(Algoritm);
+    const int32 L_MaxIterations = IK_MaxIterations;
+    const float L_Tollerance = IK_ErrorTollerance;
+
+    AsyncTask( ENamedThreads::AnyBackgroundThreadNormalTask, [L_Segments, L_LimbMaxExtent, L_Resolution, L_ApplyAngularLimits, L_MaxIterations, L_Tollerance, L_Version, this] ()
+    {
+        FMPAS_LimbWarmStartLookup NewLookup = BuildWarmStartLookup(L_Segments, L_LimbMaxExtent, L_Resolution, L_ApplyAngularLimits, L_MaxIterations, L_Tollerance);
+
+        // Calling back to the game thread, outdated builds are discarded
+        AsyncTask( ENamedThreads::GameThread, [NewLookup, L_Version, this] ()
+        {
+            if (L_Version == WarmStartLookupVersion)
+                WarmStartLookup = NewLookup;
+        });
+    });
+}
+
+// Evaluates origin, target, up vector and all pole targets of the limb, target stack is evaluated exactly once
+void UMPAS_Limb::GatherSolveInput(FMPAS_LimbSolveInput& OutInput)
+{
+    OutInput.OriginLocation = GetComponentLocation();
+    OutInput.TargetLocation = GetLimbTarget();
+    OutInput.UpVector = GetUpVector();
+
+    // Pole target calclulation
+    OutInput.PoleTargets.Reset(Segments.Num());
+
+    // Base value just to make sure there always is at least some kind of a pole target
+    FVector LastCalculatedPoleTarget = (OutInput.OriginLocation + OutInput.TargetLocation) / 2 + OutInput.UpVector * 10000;
+
+    for (int32 i = 0; i < Segments.Num(); i++)
+    {
+        if (const FMPAS_LimbPoleTarget* Pole = PoleTargets.Find(i))
+            LastCalculatedPoleTarget = CalculatePoleTargetLocation(*Pole, OutInput.OriginLocation, OutInput.TargetLocation, OutInput.UpVector);
+
+        OutInput.PoleTargets.Add(LastCalculatedPoleTarget);
+    }
 }
 
 // Updates the current state of the specified segment
@@ -271,22 +542,24 @@ void UMPAS_Limb::WriteSegmentState(int32 InSegment, const FMPAS_LimbSegmentState
 // Handles interpolation of the current state to the target state
 void UMPAS_Limb::InterpolateLimb(float DeltaTime)
 {
+    if (InterpolationMode == EMPAS_LimbInterpolationMode::QuaternionSpring)
+        InterpolateLimb_Spring(DeltaTime);
+
     // Ignore interpolation if LimbInterpolationSpeed is set to 0 or less
-    if (LimbInterpolationSpeed > 0)
+    else if (LimbInterpolationSpeed > 0)
     {
-        FVector NextSegmentLocation = GetComponentLocation();
+        const FVector L_Origin = GetComponentLocation();
 
-        for (int i = 0 ; i < CurrentState.Num() - 1; i++)
+        for (int i = 0 ; i < CurrentState.Num(); i++)
         {
-            CurrentState[i].Rotation = UKismetMathLibrary::RInterpTo_Constant(CurrentState[i].Rotation, TargetState[i].Rotation, DeltaTime, LimbInterpolationSpeed);
+            // Each state starts at the end of it's parent segment
+            const int32 L_Parent = StateParents.IsValidIndex(i) ? StateParents[i] : i - 1;
+            CurrentState[i].Location = (L_Parent < 0) ? L_Origin : CurrentState[L_Parent].Location + Segments[L_Parent].Length * UKismetMathLibrary::GetForwardVector(CurrentState[L_Parent].Rotation);
 
-            CurrentState[i].Location = NextSegmentLocation;
-
-            NextSegmentLocation = CurrentState[i].Location + Segments[i].Length * UKismetMathLibrary::GetForwardVector(CurrentState[i].Rotation);
+            // Fective segment at the tip of the chain has no rotation of it's own
+            if (i < Segments.Num())
+                CurrentState[i].Rotation = UKismetMathLibrary::RInterpTo_Constant(CurrentState[i].Rotation, TargetState[i].Rotation, DeltaTime, LimbInterpolationSpeed);
         }
-
-        // Fective segment's location update
-        CurrentState[CurrentState.Num() - 1].Location = NextSegmentLocation;
     }
 
     else
@@ -298,19 +571,184 @@ void UMPAS_Limb::InterpolateLimb(float DeltaTime)
         WriteSegmentState(i, CurrentState[i]);
 }
 
+// Moves current segment rotations towards the target state with a critically damped spring, rebuilding segment locations
+void UMPAS_Limb::InterpolateLimb_Spring(float DeltaTime)
+{
+    const int32 L_StateNum = CurrentState.Num();
+
+    // Nothing has been solved yet
+    if (TargetRotations.Num() != L_StateNum || TargetState.Num() != L_StateNum)
+        return;
+
+    // (Re)starting the springs from the current state, if the chain has changed
+    if (SpringRotations.Num() != L_StateNum)
+    {
+        SpringRotations.SetNum(L_StateNum, EAllowShrinking::No);
+        SpringAngularVelocities.SetNum(L_StateNum, EAllowShrinking::No);
+
+        for (int32 i = 0; i < L_StateNum; i++)
+        {
+            SpringRotations[i] = CurrentState[i].Rotation.Quaternion();
+            SpringAngularVelocities[i] = FVector::ZeroVector;
+        }
+    }
+
+    // Instant transition
+    if (SpringHalfLife <= 0.f)
+    {
+        for (int32 i = 0; i < L_StateNum; i++)
+        {
+            SpringRotations[i] = TargetRotations[i];
+            SpringAngularVelocities[i] = FVector::ZeroVector;
+        }
+
+        CurrentState = TargetState;
+        return;
+    }
+
+    /*
+     * Critically damped spring (exact solution), evaluated in the tangent space of the target rotation.
+     * Damping and the decay factor are shared by all segments, so there is only one exp() per limb.
+     */
+    const float L_Damping = 2.f * UE_LN2 / SpringHalfLife;
+    const float L_Decay = FMath::Exp(-L_Damping * DeltaTime);
+
+    const FVector L_Origin = GetComponentLocation();
+
+    for (int32 i = 0; i < L_StateNum; i++)
+    {
+        // Each state starts at the end of it's parent segment
+        const int32 L_Parent = StateParents.IsValidIndex(i) ? StateParents[i] : i - 1;
+        CurrentState[i].Location = (L_Parent < 0) ? L_Origin : CurrentState[L_Parent].Location + Segments[L_Parent].Length * SpringRotations[L_Parent].GetForwardVector();
+
+        // Fective segment at the tip of the chain has no rotation of it's own
+        if (i >= Segments.Num())
+            continue;
+
+        const FQuat& L_Goal = TargetRotations[i];
+
+        // Taking the shortest path to the goal
+        FQuat L_Difference = SpringRotations[i] * L_Goal.Inverse();
+        if (L_Difference.W < 0.f)
+            L_Difference = -L_Difference;
+
+        const FVector L_J0 = L_Difference.ToRotationVector();
+        const FVector L_J1 = SpringAngularVelocities[i] + L_J0 * L_Damping;
+
+        SpringRotations[i] = FQuat::MakeFromRotationVector(L_Decay * (L_J0 + L_J1 * DeltaTime)) * L_Goal;
+        SpringRotations[i].Normalize();
+
+        SpringAngularVelocities[i] = L_Decay * (SpringAngularVelocities[i] - L_J1 * L_Damping * DeltaTime);
+
+        CurrentState[i].Rotation = SpringRotations[i].Rotator();
+    }
+}
+
+// Starts asynchronous clearance sweeps for the next Clearance_QueriesPerUpdate segments of the target state
+void UMPAS_Limb::DispatchClearanceQueries()
+{
+    const int32 L_SegmentNum = Segments.Num();
+    if (L_SegmentNum == 0 || TargetState.Num() != L_SegmentNum + 1 || !GetWorld())
+        return;
+
+    // The constraint was enabled after the latest solve, so the target state has not been corrected yet
+    if (UncorrectedTargetState.Num() != L_SegmentNum + 1)
+        UncorrectedTargetState = TargetState;
+
+    if (ClearanceCorrections.Num() != L_SegmentNum)
+    {
+        ClearanceCorrections.Init(FVector::ZeroVector, L_SegmentNum);
+        ClearanceCursor = 0;
+    }
+
+    if (!ClearanceTraceDelegate.IsBound())
+        ClearanceTraceDelegate.BindUObject(this, &UMPAS_Limb::OnClearanceSweepCompleted);
+
+    FCollisionQueryParams L_QueryParams(SCENE_QUERY_STAT(MPAS_LimbClearance), false, Clearance_IgnoreOwner ? GetOwner() : nullptr);
+    if (Fetch_MeshComponent)
+        L_QueryParams.AddIgnoredComponent(Fetch_MeshComponent);
+
+    const FCollisionShape L_Shape = FCollisionShape::MakeSphere(Clearance_Radius);
+
+    for (int32 q = 0; q < FMath::Min(Clearance_QueriesPerUpdate, L_SegmentNum); q++)
+    {
+        const int32 L_Segment = ClearanceCursor;
+        ClearanceCursor = (ClearanceCursor + 1) % L_SegmentNum;
+
+        GetWorld()->AsyncSweepByChannel(EAsyncTraceType::Single, UncorrectedTargetState[L_Segment].Location, UncorrectedTargetState[L_Segment + 1].Location, FQuat::Identity, Clearance_Channel, L_Shape, L_QueryParams, FCollisionResponseParams::DefaultResponseParam, &ClearanceTraceDelegate, (uint32)L_Segment);
+    }
+}
+
+// Receives the result of a clearance sweep (the segment index is passed as user data)
+void UMPAS_Limb::OnClearanceSweepCompleted(const FTraceHandle& InTraceHandle, FTraceDatum& InTraceDatum)
+{
+    const int32 L_Segment = (int32)InTraceDatum.UserData;
+
+    // The chain has changed since the sweep was started
+    if (!ClearanceCorrections.IsValidIndex(L_Segment))
+        return;
+
+    // How far the segment capsule of the uncorrected solution has to move along the surface normal to clear the hit point
+    float L_Depth = 0.f;
+    FVector L_Normal = FVector::ZeroVector;
+
+    if (InTraceDatum.OutHits.Num() > 0 && InTraceDatum.OutHits[0].bBlockingHit)
+    {
+        const FHitResult& Hit = InTraceDatum.OutHits[0];
+        L_Normal = Hit.ImpactNormal;
+
+        if (Hit.bStartPenetrating)
+            L_Depth = Hit.PenetrationDepth;
+
+        else
+        {
+            const FVector L_ClosestPoint = FMath::ClosestPointOnSegment(Hit.ImpactPoint, InTraceDatum.Start, InTraceDatum.End);
+            L_Depth = Clearance_Radius - (Hit.ImpactPoint - L_ClosestPoint).Size();
+        }
+    }
+
+    const FVector L_PreviousCorrection = ClearanceCorrections[L_Segment];
+
+    // The uncorrected solution is clear, the correction fades out
+    if (L_Depth <= 0.f)
+    {
+        ClearanceCorrections[L_Segment] *= Clearance_CorrectionDecay;
+
+        if (ClearanceCorrections[L_Segment].SizeSquared() < 0.01f)
+            ClearanceCorrections[L_Segment] = FVector::ZeroVector;
+    }
+
+    // The uncorrected solution penetrates the environment, the full correction is applied
+    else
+        ClearanceCorrections[L_Segment] = (L_Normal * L_Depth).GetClampedToMaxSize(Segments[L_Segment].Length);
+
+    // The solution has to be corrected even if the inputs have not changed
+    if (ClearanceCorrections[L_Segment] != L_PreviousCorrection)
+        ClearanceDirty = true;
+}
+
 // Calculates resulting location of the pole target in world space
 FVector UMPAS_Limb::CalculatePoleTargetLocation(const FMPAS_LimbPoleTarget& InPoleTargetSettings)
+{
+    // Only auto calculation needs limb's target
+    if (InPoleTargetSettings.LocationMode == EMPAS_LimbPoleTargetLocationMode::AutoCalculation)
+        return CalculatePoleTargetLocation(InPoleTargetSettings, GetComponentLocation(), GetLimbTarget(), GetUpVector());
+
+    return CalculatePoleTargetLocation(InPoleTargetSettings, FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector);
+}
+
+// Calculates resulting location of the pole target in world space, using already evaluated limb origin, target and up vector
+FVector UMPAS_Limb::CalculatePoleTargetLocation(const FMPAS_LimbPoleTarget& InPoleTargetSettings, const FVector& InOriginLocation, const FVector& InTargetLocation, const FVector& InUpVector)
 {
     // Auto calculation mode
     if (InPoleTargetSettings.LocationMode == EMPAS_LimbPoleTargetLocationMode::AutoCalculation)
     {
-        FVector ForwardVector = (GetLimbTarget() - GetComponentLocation()).GetSafeNormal();
-        FVector UpVector = GetUpVector();
-        FVector RightVector = UKismetMathLibrary::Cross_VectorVector(ForwardVector, UpVector).GetSafeNormal();
+        FVector ForwardVector = (InTargetLocation - InOriginLocation).GetSafeNormal();
+        FVector RightVector = UKismetMathLibrary::Cross_VectorVector(ForwardVector, InUpVector).GetSafeNormal();
 
-        return GetComponentLocation() + (ForwardVector * InPoleTargetSettings.AUTO_PoleTargetOffset.X 
+        return InOriginLocation + (ForwardVector * InPoleTargetSettings.AUTO_PoleTargetOffset.X 
                         + RightVector * InPoleTargetSettings.AUTO_PoleTargetOffset.Y
-                        + UpVector * InPoleTargetSettings.AUTO_PoleTargetOffset.Z);
+                        + InUpVector * InPoleTargetSettings.AUTO_PoleTargetOffset.Z);
     }
 
     // Location stack mode
@@ -323,9 +761,237 @@ FVector UMPAS_Limb::CalculatePoleTargetLocation(const FMPAS_LimbPoleTarget& InPo
 }
 
 
-// Algorithms
-// 'static' because they are going to run in a background thread
+// CALLED BY THE HANDLER : Whether the limb is going to compete for the handler's IK iteration budget
+bool UMPAS_Limb::RequiresIterationBudget()
+{
+    // Only limbs, whose inputs have changed during this rig update, are going to dispatch a solve
+    return SolvePending && UsesIterativeSolver();
+}
+
+// CALLED BY THE HANDLER : Priority of the limb in the IK iteration budget distribution (significance, error magnitude, visibility and starvation time)
+float UMPAS_Limb::GetIterationBudgetPriority() const
+{
+    // Limbs that are far from their targets need iterations the most
+    float Priority = IK_Significance * (1.f + LastSolveError / FMath::Max(IK_ErrorTollerance, KINDA_SMALL_NUMBER));
+
+    // Limbs that are not visible can wait
+    if (GetOwner() && !GetOwner()->WasRecentlyRendered(0.2f))
+        Priority *= 0.25f;
+
+    // Every skipped update raises the priority, so no limb is starved forever
+    return Priority * (1.f + FramesSinceLastSolve);
+}
+
+// CALLED BY THE HANDLER : How many iterations the limb is expected to need on this update
+int32 UMPAS_Limb::GetEstimatedIterationNeed() const
+{
+    // Converged limbs usually need about as many iterations as they did last time
+    if (HasCachedSolution && LastSolveConverged)
+        return FMath::Clamp(LastSolveIterations, 1, IK_MaxIterations);
+
+    return IK_MaxIterations;
+}
+
+
+// Algorithms
+// 'static' because they are going to run in a background thread
+
+
+// Selects and runs the requested algorithm, recalculates segment roll if needed, OutConverged is set if the result has reached the target
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::ExecuteSolvingAlgorithm(EMPAS_LimbSolvingAlgorithm InAlgorithm, const FMPAS_LimbSolveInput& InInput, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, float InLimbMaxExtent, bool InWarmStart, bool InEnableRollRecalculation, float InLimbRoll, EMPAS_LimbRollRecalculationMode InRollRecalculationMode, const FMPAS_LimbSolverKernels& InKernels, bool& OutConverged, int32& OutIterations, float& OutError)
+{
+    // New state declaration
+    TArray<FMPAS_LimbSegmentState> NewState;
+
+    OutIterations = 0;
+
+    // Selecting an algorithm and calling solving 
+    switch (InAlgorithm)
+    {
+    case EMPAS_LimbSolvingAlgorithm::FABRIK_IK: NewState = (InKernels.FABRIK_IK ? InKernels.FABRIK_IK : &Solve_FABRIK_IK)(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState, InMaxIterations, InTollerance, &OutIterations); break;
+    case EMPAS_LimbSolvingAlgorithm::FABRIK_Limited_IK: NewState = Solve_FABRIK_Limited_IK(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState, InMaxIterations, InTollerance, &OutIterations); break;
+    case EMPAS_LimbSolvingAlgorithm::CCD_IK: NewState = Solve_CCD_IK(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState, InMaxIterations, InTollerance, &OutIterations); break;
+    case EMPAS_LimbSolvingAlgorithm::CCD_Limited_IK: NewState = Solve_CCD_Limited_IK(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState, InMaxIterations, InTollerance, &OutIterations); break;
+    case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_IK: NewState = (InKernels.PoleFABRIK_IK ? InKernels.PoleFABRIK_IK : &Solve_PoleFABRIK_IK)(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState, InInput.PoleTargets, InMaxIterations, InTollerance, InInput.UpVector, InWarmStart, &OutIterations); break;
+    case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_Limited_IK: NewState = Solve_PoleFABRIK_Limited_IK(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState, InInput.PoleTargets, InMaxIterations, InTollerance, InInput.UpVector, InWarmStart, &OutIterations); break;
+    case EMPAS_LimbSolvingAlgorithm::PistonMulti: NewState = Solve_Piston_Multi(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState, InLimbMaxExtent); break;
+    case EMPAS_LimbSolvingAlgorithm::PistonSequential: NewState = Solve_Piston_Sequential(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState); break;
+    case EMPAS_LimbSolvingAlgorithm::RotateToTarget: NewState = Solve_RotateToTarget(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState); break;
+
+    case EMPAS_LimbSolvingAlgorithm::Gauss_Seidel: NewState = Solve_Gauss_Seidel_IK(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState, InInput.PoleTargets, InMaxIterations, InTollerance, InInput.UpVector, InWarmStart, &OutIterations); break;
+    case EMPAS_LimbSolvingAlgorithm::Gauss_Seidel_Limited: NewState = Solve_Gauss_Seidel_Limited_IK(InInput.OriginLocation, InInput.TargetLocation, InSegments, InCurrentState, InInput.PoleTargets, InMaxIterations, InTollerance, InInput.UpVector, InWarmStart, &OutIterations); break;
+
+    default: break;
+    }
+
+    // Single pass algorithms always produce their final result, iterative ones have converged only if the tip has reached the target
+    OutError = NewState.Num() > 0 ? (NewState[NewState.Num() - 1].Location - InInput.TargetLocation).Size() : 0.f;
+    OutConverged = !IsIterativeAlgorithm(InAlgorithm) || (NewState.Num() > 0 && OutError <= InTollerance);
+
+    // Recalculating segment roll
+    if (InEnableRollRecalculation)
+    {
+        if (InRollRecalculationMode == EMPAS_LimbRollRecalculationMode::ParallelTransport)
+            RecalculateRoll_ParallelTransport(NewState, InLimbRoll, InInput.OriginLocation, InSegments, InInput.PoleTargets, InInput.UpVector);
+
+        else
+            RecalculateRoll(NewState, InLimbRoll, InInput.OriginLocation, InInput.TargetLocation, InSegments, InInput.PoleTargets, InInput.UpVector);
+    }
+
+    return NewState;
+}
+
+// Whether the algorithm iteratively approaches the target (the rest of the algorithms are solved in a single pass)
+bool UMPAS_Limb::IsIterativeAlgorithm(EMPAS_LimbSolvingAlgorithm InAlgorithm)
+{
+    switch (InAlgorithm)
+    {
+    case EMPAS_LimbSolvingAlgorithm::FABRIK_IK:
+    case EMPAS_LimbSolvingAlgorithm::FABRIK_Limited_IK:
+    case EMPAS_LimbSolvingAlgorithm::CCD_IK:
+    case EMPAS_LimbSolvingAlgorithm::CCD_Limited_IK:
+    case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_IK:
+    case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_Limited_IK:
+    case EMPAS_LimbSolvingAlgorithm::Gauss_Seidel:
+    case EMPAS_LimbSolvingAlgorithm::Gauss_Seidel_Limited:
+        return true;
+
+    default: return false;
+    }
+}
+
+// Whether the algorithm applies angular limits of the segments
+bool UMPAS_Limb::IsLimitedAlgorithm(EMPAS_LimbSolvingAlgorithm InAlgorithm)
+{
+    switch (InAlgorithm)
+    {
+    case EMPAS_LimbSolvingAlgorithm::FABRIK_Limited_IK:
+    case EMPAS_LimbSolvingAlgorithm::CCD_Limited_IK:
+    case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_Limited_IK:
+    case EMPAS_LimbSolvingAlgorithm::Gauss_Seidel_Limited:
+        return true;
+
+    default: return false;
+    }
+}
+
+// Whether the algorithm seeds cold starts from the pole targets (its bend plane comes from that seeding)
+bool UMPAS_Limb::IsPoleSeededAlgorithm(EMPAS_LimbSolvingAlgorithm InAlgorithm)
+{
+    switch (InAlgorithm)
+    {
+    case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_IK:
+    case EMPAS_LimbSolvingAlgorithm::PoleFABRIK_Limited_IK:
+    case EMPAS_LimbSolvingAlgorithm::Gauss_Seidel:
+    case EMPAS_LimbSolvingAlgorithm::Gauss_Seidel_Limited:
+        return true;
+
+    default: return false;
+    }
+}
+
+// Solves the limb for the center of every cell of a grid around the origin, each cell is seeded with the pose of the previous one
+FMPAS_LimbWarmStartLookup UMPAS_Limb::BuildWarmStartLookup(const TArray<FMPAS_LimbSegmentData>& InSegments, float InLimbMaxExtent, int32 InResolution, bool InApplyAngularLimits, int32 InMaxIterations, float InTollerance)
+{
+    FMPAS_LimbWarmStartLookup Lookup;
+
+    if (InSegments.Num() == 0 || InLimbMaxExtent <= 0.f || InResolution <= 0)
+        return Lookup;
+
+    Lookup.Resolution = InResolution;
+    Lookup.Extent = InLimbMaxExtent;
+    Lookup.CellSize = 2.f * InLimbMaxExtent / InResolution;
+    Lookup.SegmentNum = InSegments.Num();
+
+    const int32 L_CellNum = InResolution * InResolution * InResolution;
+    Lookup.Reachable.SetNumZeroed(L_CellNum);
+    Lookup.Directions.SetNumUninitialized(L_CellNum * Lookup.SegmentNum);
+
+    // Straight up initial pose (origin is at zero)
+    TArray<FMPAS_LimbSegmentState> State;
+    State.SetNum(InSegments.Num() + 1);
+
+    FVector L_Location = FVector::ZeroVector;
+    for (int32 i = 0; i < State.Num(); i++)
+    {
+        State[i].Location = L_Location;
+        State[i].Rotation = FVector::UpVector.Rotation();
+
+        if (i < InSegments.Num())
+            L_Location += FVector::UpVector * InSegments[i].Length;
+    }
+
+    for (int32 Z = 0; Z < InResolution; Z++)
+        for (int32 Y = 0; Y < InResolution; Y++)
+            for (int32 X = 0; X < InResolution; X++)
+            {
+                const int32 L_Cell = X + (Y + Z * InResolution) * InResolution;
+                const FVector L_Target = Lookup.GetCellCenter(X, Y, Z);
+
+                // Cells outside of the max extent are never reachable, the chain is simply pointed at them
+                if (L_Target.SizeSquared() > InLimbMaxExtent * InLimbMaxExtent)
+                {
+                    const FVector L_Direction = L_Target.GetSafeNormal();
+                    for (int32 i = 0; i < Lookup.SegmentNum; i++)
+                        Lookup.Directions[L_Cell * Lookup.SegmentNum + i] = L_Direction;
+
+                    continue;
+                }
+
+                // Seeded with the pose of the previously solved cell
+                State = InApplyAngularLimits ? Solve_FABRIK_Limited_IK(FVector::ZeroVector, L_Target, InSegments, State, InMaxIterations, InTollerance)
+                                             : Solve_FABRIK_IK(FVector::ZeroVector, L_Target, InSegments, State, InMaxIterations, InTollerance);
+
+                Lookup.Reachable[L_Cell] = (State.Last().Location - L_Target).Size() <= InTollerance;
+
+                for (int32 i = 0; i < Lookup.SegmentNum; i++)
+                    Lookup.Directions[L_Cell * Lookup.SegmentNum + i] = (State[i + 1].Location - State[i].Location).GetSafeNormal();
+            }
+
+    return Lookup;
+}
+
+// Overwrites the state with the pose, stored in the given cell of the lookup
+void UMPAS_Limb::ApplyWarmStartPose(const FMPAS_LimbWarmStartLookup& InLookup, int32 InCellIndex, const FVector& InOriginLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, TArray<FMPAS_LimbSegmentState>& InOutState)
+{
+    if (InSegments.Num() == 0 || InOutState.Num() != InSegments.Num() + 1 || InLookup.SegmentNum != InSegments.Num())
+        return;
+
+    FVector L_Location = InOriginLocation;
+    for (int32 i = 0; i < InSegments.Num(); i++)
+    {
+        const FVector& L_Direction = InLookup.Directions[InCellIndex * InLookup.SegmentNum + i];
+
+        InOutState[i].Location = L_Location;
+        InOutState[i].Rotation = L_Direction.Rotation();
+
+        L_Location += L_Direction * InSegments[i].Length;
+    }
+
+    // Fective segment
+    InOutState.Last().Location = L_Location;
+    InOutState.Last().Rotation = InOutState[InSegments.Num() - 1].Rotation;
+}
+
+
+// Selects solver kernels, specialized for the given segment count (2, 3, 4 and 6 segments are supported)
+FMPAS_LimbSolverKernels UMPAS_Limb::SelectSolverKernels(int32 InSegmentCount)
+{
+    FMPAS_LimbSolverKernels Kernels;
+
+    switch (InSegmentCount)
+    {
+    case 2: Kernels.FABRIK_IK = &Solve_FABRIK_IK_Fixed<2>; Kernels.PoleFABRIK_IK = &Solve_PoleFABRIK_IK_Fixed<2>; break;
+    case 3: Kernels.FABRIK_IK = &Solve_FABRIK_IK_Fixed<3>; Kernels.PoleFABRIK_IK = &Solve_PoleFABRIK_IK_Fixed<3>; break;
+    case 4: Kernels.FABRIK_IK = &Solve_FABRIK_IK_Fixed<4>; Kernels.PoleFABRIK_IK = &Solve_PoleFABRIK_IK_Fixed<4>; break;
+    case 6: Kernels.FABRIK_IK = &Solve_FABRIK_IK_Fixed<6>; Kernels.PoleFABRIK_IK = &Solve_PoleFABRIK_IK_Fixed<6>; break;
 
+    // Generic solvers
+    default: break;
+    }
+
+    return Kernels;
+}
 
 // Rotate To Target
 TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_RotateToTarget(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState)
@@ -350,7 +1016,7 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_RotateToTarget(const FVector& I
 
 
 // FABRIK IK
-TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_FABRIK_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance)
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_FABRIK_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations)
 {
     TArray<FMPAS_LimbSegmentState> State = InCurrentState;
 
@@ -381,11 +1047,14 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_FABRIK_IK(const FVector& InOrig
         Iteration++;
     }
 
+    if (OutIterations)
+        *OutIterations = Iteration;
+
     return State;
 }
 
 // FABRIK Limited
-TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_FABRIK_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance)
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_FABRIK_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations)
 {
     TArray<FMPAS_LimbSegmentState> State = InCurrentState;
 
@@ -400,7 +1069,13 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_FABRIK_Limited_IK(const FVector
             FVector DirectionVector = (State[i - 1].Location - State[i].Location).GetSafeNormal();
 
             // Angular limits
-            if (i > 1)
+            if (i > 1 && InSegments[i - 1].AngularLimitModel == EMPAS_LimbAngularLimitModel::SwingTwist)
+            {
+                const FVector ParentDirection = (State[i - 1].Location - State[i - 2].Location).GetSafeNormal();
+                DirectionVector = -1 * ClampSegmentDirection(-1 * DirectionVector, ParentDirection, InSegments[i - 1]);
+            }
+
+            else if (i > 1)
             {
                 FRotator DirectionRotation = (-1 * DirectionVector).Rotation();
 
@@ -426,7 +1101,13 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_FABRIK_Limited_IK(const FVector
             FVector DirectionVector = (State[i + 1].Location - State[i].Location).GetSafeNormal();
 
             // Angular limits
-            if (i > 0)
+            if (i > 0 && InSegments[i].AngularLimitModel == EMPAS_LimbAngularLimitModel::SwingTwist)
+            {
+                const FVector ParentDirection = (State[i].Location - State[i - 1].Location).GetSafeNormal();
+                DirectionVector = ClampSegmentDirection(DirectionVector, ParentDirection, InSegments[i]);
+            }
+
+            else if (i > 0)
             {
                 FRotator DirectionRotation = DirectionVector.Rotation();
 
@@ -448,55 +1129,272 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_FABRIK_Limited_IK(const FVector
         Iteration++;
     }
 
+    if (OutIterations)
+        *OutIterations = Iteration;
+
+    return State;
+}
+
+
+/*
+    Fixed size kernels
+    Joint locations and segment lengths are copied into stack arrays, so passes run without bounds checks or allocations,
+    and since the loop bounds are compile-time constants, compilers fully unroll the passes for the supported segment counts.
+    Segment rotations are only derived from joint locations once, after the last iteration.
+*/
+
+// FABRIK IK, specialized for a fixed segment count
+template<int32 N>
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_FABRIK_IK_Fixed(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations)
+{
+    if (InSegments.Num() != N || InCurrentState.Num() != N + 1)
+        return Solve_FABRIK_IK(InOriginLocation, InTargetLocation, InSegments, InCurrentState, InMaxIterations, InTollerance, OutIterations);
+
+    FVector Joints[N + 1];
+    float Lengths[N];
+
+    for (int32 i = 0; i < N; i++)
+    {
+        Joints[i] = InCurrentState[i].Location;
+        Lengths[i] = InSegments[i].Length;
+    }
+    Joints[N] = InCurrentState[N].Location;
+
+    const float OriginTollerance = InTollerance * 0.1f;
+
+    int32 Iteration = 0;
+    while ((Iteration < InMaxIterations) && (((Joints[N] - InTargetLocation).Size() > InTollerance) || ((Joints[0] - InOriginLocation).Size() > OriginTollerance)))
+    {
+        // Forward-Reaching pass
+        Joints[N] = InTargetLocation;
+        for (int32 i = N; i > 0; i--)
+            Joints[i - 1] = Joints[i] + (Joints[i - 1] - Joints[i]).GetSafeNormal() * Lengths[i - 1];
+
+        // Backward-Reaching pass
+        Joints[0] = InOriginLocation;
+        for (int32 i = 0; i < N; i++)
+            Joints[i + 1] = Joints[i] + (Joints[i + 1] - Joints[i]).GetSafeNormal() * Lengths[i];
+
+        Iteration++;
+    }
+
+    if (OutIterations)
+        *OutIterations = Iteration;
+
+    // Nothing has changed
+    if (Iteration == 0)
+        return InCurrentState;
+
+    TArray<FMPAS_LimbSegmentState> State = InCurrentState;
+    for (int32 i = 0; i < N; i++)
+    {
+        State[i].Location = Joints[i];
+        State[i].Rotation = (Joints[i + 1] - Joints[i]).GetSafeNormal().Rotation();
+    }
+    State[N].Location = Joints[N];
+
+    return State;
+}
+
+// PoleFABRIK IK, specialized for a fixed segment count
+template<int32 N>
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_PoleFABRIK_IK_Fixed(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations)
+{
+    if (InSegments.Num() != N || InCurrentState.Num() != N + 1 || InPoleTargets.Num() < N)
+        return Solve_PoleFABRIK_IK(InOriginLocation, InTargetLocation, InSegments, InCurrentState, InPoleTargets, InMaxIterations, InTollerance, InUpVector, InWarmStart, OutIterations);
+
+    FVector Joints[N + 1];
+    float Lengths[N];
+
+    for (int32 i = 0; i < N; i++)
+        Lengths[i] = InSegments[i].Length;
+
+    // Warm start : continuing from the previous solution
+    if (InWarmStart)
+    {
+        for (int32 i = 0; i <= N; i++)
+            Joints[i] = InCurrentState[i].Location;
+    }
+
+    // Reinitiating state to match pole targets
+    else
+    {
+        Joints[0] = InOriginLocation;
+        for (int32 i = 0; i < N; i++)
+            Joints[i + 1] = Joints[i] + (InPoleTargets[i] - Joints[i]).GetSafeNormal() * Lengths[i];
+    }
+
+    // The last segment is only oriented in the forward pass (the backward pass does not reach the tip)
+    FVector LastSegmentDirection = FVector::ZeroVector;
+
+    const float OriginTollerance = InTollerance * 0.1f;
+
+    int32 Iteration = 0;
+    while ((Iteration < InMaxIterations) && (((Joints[N] - InTargetLocation).Size() > InTollerance) || ((Joints[0] - InOriginLocation).Size() > OriginTollerance)))
+    {
+        // Forward-Reaching pass
+        Joints[N] = InTargetLocation;
+        for (int32 i = N; i > 0; i--)
+        {
+            const FVector DirectionVector = (Joints[i - 1] - Joints[i]).GetSafeNormal();
+            Joints[i - 1] = Joints[i] + DirectionVector * Lengths[i - 1];
+
+            if (i == N)
+                LastSegmentDirection = -1 * DirectionVector;
+        }
+
+        // Backward-Reaching pass
+        Joints[0] = InOriginLocation;
+        for (int32 i = 0; i < N - 1; i++)
+            Joints[i + 1] = Joints[i] + (Joints[i + 1] - Joints[i]).GetSafeNormal() * Lengths[i];
+
+        Iteration++;
+    }
+
+    if (OutIterations)
+        *OutIterations = Iteration;
+
+    TArray<FMPAS_LimbSegmentState> State;
+
+    // Without iterations, the state is the seed itself (same as in the generic solver)
+    if (Iteration == 0)
+    {
+        if (InWarmStart)
+            return InCurrentState;
+
+        State.SetNum(N + 1);
+        for (int32 i = 0; i <= N; i++)
+            State[i].Location = Joints[i];
+
+        return State;
+    }
+
+    State.SetNum(N + 1);
+    for (int32 i = 0; i < N - 1; i++)
+    {
+        State[i].Location = Joints[i];
+        State[i].Rotation = (Joints[i + 1] - Joints[i]).GetSafeNormal().Rotation();
+    }
+
+    State[N - 1].Location = Joints[N - 1];
+    State[N - 1].Rotation = LastSegmentDirection.Rotation();
+
+    State[N].Location = Joints[N];
+    if (InWarmStart)
+        State[N].Rotation = InCurrentState[N].Rotation;
+
     return State;
 }
 
 
 // CCD IK
-TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_CCD_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance)
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_CCD_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations)
+{
+    return SolveCCD(InOriginLocation, InTargetLocation, InSegments, InCurrentState, InMaxIterations, InTollerance, false, OutIterations);
+}
+
+// CCD Limited
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_CCD_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations)
+{
+    return SolveCCD(InOriginLocation, InTargetLocation, InSegments, InCurrentState, InMaxIterations, InTollerance, true, OutIterations);
+}
+
+/*
+    Rotating joint i rigidly rotates everything after it around joint's location, while joints before it stay in place.
+    This means that during a tip-to-root sweep only the tip location has to be updated, and each joint's world rotation delta can be remembered.
+    After the sweep, segment j has received deltas D_j, D_j-1, ..., D_0 (in that order), so it's final rotation is (D_0 * ... * D_j) * Q_j,
+    which is a prefix product that is rebuilt together with segment locations in a single forward pass.
+    Relative rotation between a segment and it's parent is not affected by the deltas of the earlier joints, so limits can be enforced right away.
+*/
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::SolveCCD(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, bool InApplyAngularLimits, int32* OutIterations)
 {
     TArray<FMPAS_LimbSegmentState> State = InCurrentState;
 
-    State[0].Location = InOriginLocation;
+    const int32 SegmentCount = InSegments.Num();
+    if (SegmentCount == 0 || State.Num() != SegmentCount + 1)
+        return State;
+
+    // Working data : world rotations of segments and rotation deltas of the current sweep
+    TArray<FQuat> Rotations;
+    TArray<FQuat> Deltas;
+    Rotations.SetNum(SegmentCount);
+    Deltas.SetNum(SegmentCount);
+
+    for (int32 i = 0; i < SegmentCount; i++)
+        Rotations[i] = State[i].Rotation.Quaternion();
 
     // Initial location recalculation, handling cases, where target location didn't change, but the origin location did
-    for (int32 j = 1; j < State.Num(); j++)
-        State[j].Location = State[j - 1].Location + UKismetMathLibrary::GetForwardVector(State[j - 1].Rotation) * InSegments[j - 1].Length;
-   
+    State[0].Location = InOriginLocation;
+    for (int32 i = 0; i < SegmentCount; i++)
+        State[i + 1].Location = State[i].Location + Rotations[i].GetForwardVector() * InSegments[i].Length;
+
     size_t Iteration = 0;
-    while ((Iteration < InMaxIterations) && ( (State[State.Num() - 1].Location - InTargetLocation).Size() > InTollerance) )
+    while ((Iteration < InMaxIterations) && ((State[SegmentCount].Location - InTargetLocation).Size() > InTollerance))
     {
-        // Main CCD pass
-        for (int32 i = State.Num() - 2; i >= 0; i--)
-        {   
-            State[i].Rotation = UKismetMathLibrary::ComposeRotators(UKismetMathLibrary::NormalizedDeltaRotator(UKismetMathLibrary::FindLookAtRotation(State[i].Location, State[State.Num() - 1].Location), UKismetMathLibrary::FindLookAtRotation(State[i].Location, InTargetLocation)), State[i].Rotation);
+        FVector TipLocation = State[SegmentCount].Location;
+
+        // Main CCD pass (tip to root), only the tip location is tracked
+        for (int32 i = SegmentCount - 1; i >= 0; i--)
+        {
+            const FVector& JointLocation = State[i].Location;
+
+            const FVector ToTip = (TipLocation - JointLocation).GetSafeNormal();
+            const FVector ToTarget = (InTargetLocation - JointLocation).GetSafeNormal();
+
+            FQuat Delta = FQuat::FindBetweenNormals(ToTip, ToTarget);
+
+            // Angular limits (the first segment is not limited, same as in other limited algorithms)
+            if (InApplyAngularLimits && i > 0)
+            {
+                const FQuat ClampedRotation = ClampRelativeSegmentRotation(Delta * Rotations[i], Rotations[i - 1], InSegments[i]);
+                Delta = ClampedRotation * Rotations[i].Inverse();
+            }
 
-            // Forward pass to recalculate segment locations
-            for (int32 j = 1; j < State.Num(); j++)
-                State[j].Location = State[j - 1].Location + UKismetMathLibrary::GetForwardVector(State[j - 1].Rotation) * InSegments[j - 1].Length;
+            Deltas[i] = Delta;
+            TipLocation = JointLocation + Delta.RotateVector(TipLocation - JointLocation);
+        }
+
+        // Forward pass, accumulating deltas and rebuilding the chain
+        FQuat AccumulatedDelta = FQuat::Identity;
+        for (int32 i = 0; i < SegmentCount; i++)
+        {
+            AccumulatedDelta = AccumulatedDelta * Deltas[i];
+
+            Rotations[i] = (AccumulatedDelta * Rotations[i]).GetNormalized();
+            State[i + 1].Location = State[i].Location + Rotations[i].GetForwardVector() * InSegments[i].Length;
         }
 
         Iteration++;
     }
 
-    if ((State[State.Num() - 1].Location - InTargetLocation).Size() <= InTollerance)
-        return State;
+    for (int32 i = 0; i < SegmentCount; i++)
+        State[i].Rotation = Rotations[i].Rotator();
+
+    if (OutIterations)
+        *OutIterations = Iteration;
 
-    return InCurrentState;
+    return State;
 }
 
 
 // PoleFABRIK IK - custom version of FABRIK IK, sligtly slower, but implements support for pole targets, making it the most usable algorithm ot of the ones presented here
-TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_PoleFABRIK_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector)
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_PoleFABRIK_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations)
 {
     TArray<FMPAS_LimbSegmentState> State;
-    State.SetNum(InCurrentState.Num());
+
+    // Warm start : continuing from the previous solution, which is usually only a few iterations away from the new one
+    if (InWarmStart && InCurrentState.Num() == InSegments.Num() + 1)
+        State = InCurrentState;
 
     // Reinitiating state to match pole targets
+    else
+    {
+        State.SetNum(InCurrentState.Num());
 
-    State[0].Location = InOriginLocation;
-    for (int32 i = 0; i < InSegments.Num(); i++)
-        State[i + 1].Location = State[i].Location + (InPoleTargets[i] - State[i].Location).GetSafeNormal() * InSegments[i].Length;
+        State[0].Location = InOriginLocation;
+        for (int32 i = 0; i < InSegments.Num(); i++)
+            State[i + 1].Location = State[i].Location + (InPoleTargets[i] - State[i].Location).GetSafeNormal() * InSegments[i].Length;
+    }
 
     // FABRIK iterating
     // Solved locationss are projected onto a solution plane (see ProjectLocationOnToSolutionPlane description) to keep the movement natural
@@ -527,20 +1425,30 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_PoleFABRIK_IK(const FVector& In
         Iteration++;
     }
 
+    if (OutIterations)
+        *OutIterations = Iteration;
+
     return State;
 }
 
 // PoleFABRIK IK - custom version of FABRIK IK, sligtly slower, but implements support for pole targets, making it the most usable algorithm ot of the ones presented here
-TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_PoleFABRIK_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector)
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_PoleFABRIK_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations)
 {
     TArray<FMPAS_LimbSegmentState> State;
-    State.SetNum(InCurrentState.Num());
+
+    // Warm start : continuing from the previous solution, which is usually only a few iterations away from the new one
+    if (InWarmStart && InCurrentState.Num() == InSegments.Num() + 1)
+        State = InCurrentState;
 
     // Reinitiating state to match pole targets
+    else
+    {
+        State.SetNum(InCurrentState.Num());
 
-    State[0].Location = InOriginLocation;
-    for (int32 i = 0; i < InSegments.Num(); i++)
-        State[i + 1].Location = State[i].Location + (InPoleTargets[i] - State[i].Location).GetSafeNormal() * InSegments[i].Length;
+        State[0].Location = InOriginLocation;
+        for (int32 i = 0; i < InSegments.Num(); i++)
+            State[i + 1].Location = State[i].Location + (InPoleTargets[i] - State[i].Location).GetSafeNormal() * InSegments[i].Length;
+    }
 
     // FABRIK iterating
     // Solved locationss are projected onto a solution plane (see ProjectLocationOnToSolutionPlane description) to keep the movement natural
@@ -555,7 +1463,13 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_PoleFABRIK_Limited_IK(const FVe
             FVector DirectionVector = (State[i - 1].Location - State[i].Location).GetSafeNormal();
 
             // Angular limits
-            if (i > 1)
+            if (i > 1 && InSegments[i - 1].AngularLimitModel == EMPAS_LimbAngularLimitModel::SwingTwist)
+            {
+                const FVector ParentDirection = (State[i - 1].Location - State[i - 2].Location).GetSafeNormal();
+                DirectionVector = -1 * ClampSegmentDirection(-1 * DirectionVector, ParentDirection, InSegments[i - 1]);
+            }
+
+            else if (i > 1)
             {
                 FRotator DirectionRotation = (-1 * DirectionVector).Rotation();
 
@@ -581,7 +1495,13 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_PoleFABRIK_Limited_IK(const FVe
             FVector DirectionVector = (State[i + 1].Location - State[i].Location).GetSafeNormal();
 
             // Angular limits
-            if (i > 0)
+            if (i > 0 && InSegments[i].AngularLimitModel == EMPAS_LimbAngularLimitModel::SwingTwist)
+            {
+                const FVector ParentDirection = (State[i].Location - State[i - 1].Location).GetSafeNormal();
+                DirectionVector = ClampSegmentDirection(DirectionVector, ParentDirection, InSegments[i]);
+            }
+
+            else if (i > 0)
             {
                 FRotator DirectionRotation = DirectionVector.Rotation();
 
@@ -603,6 +1523,9 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_PoleFABRIK_Limited_IK(const FVe
         Iteration++;
     }
 
+    if (OutIterations)
+        *OutIterations = Iteration;
+
     return State;
 }
 
@@ -664,13 +1587,139 @@ TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_Piston_Sequential(const FVector
 }
 
 
-//// Gauss-Seidel IK
-//TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_Gauss_Seidel_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector)
-//{
-//    TArray<FMPAS_LimbSegmentState> State = InCurrentState;
-//
-//    return State;
-//}
+// Gauss-Seidel IK
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_Gauss_Seidel_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations)
+{
+    return SolveGaussSeidel(InOriginLocation, InTargetLocation, InSegments, InCurrentState, InPoleTargets, InMaxIterations, InTollerance, InWarmStart, false, OutIterations);
+}
+
+// Gauss-Seidel Limited
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::Solve_Gauss_Seidel_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations)
+{
+    return SolveGaussSeidel(InOriginLocation, InTargetLocation, InSegments, InCurrentState, InPoleTargets, InMaxIterations, InTollerance, InWarmStart, true, OutIterations);
+}
+
+/*
+    Nonlinear block Gauss-Seidel : every joint rotation is a block variable, that is solved exactly while the rest of the joints are fixed,
+    and the solution is immediately used by the next joint of the sweep.
+
+    Each block solve has two parts:
+    - swing, that minimizes tip error (rotates joint-to-tip direction towards joint-to-target direction), over-relaxed to speed up convergence
+    - twist around the joint-to-tip axis, that moves the next joint as close to the segment's pole target as possible without moving the tip
+
+    Since pole targets are satisfied in the null space of the tip error, they do not fight the target like in reseeded FABRIK, which is where most of the iteration savings come from.
+    Joints are swept from tip to root, so a sweep only has to track the tip and the next joint, the chain is rebuilt once per iteration (same as CCD).
+*/
+TArray<FMPAS_LimbSegmentState> UMPAS_Limb::SolveGaussSeidel(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, bool InWarmStart, bool InApplyAngularLimits, int32* OutIterations)
+{
+    // Over-relaxation factor of the swing step, values above 1 overshoot slightly, which compensates for the joints further along the sweep undoing part of the step
+    static constexpr float RelaxationFactor = 1.25f;
+
+    const int32 SegmentCount = InSegments.Num();
+
+    TArray<FMPAS_LimbSegmentState> State;
+    State.SetNum(SegmentCount + 1);
+
+    if (SegmentCount == 0 || InPoleTargets.Num() < SegmentCount)
+        return InCurrentState;
+
+    // Working data : world rotations of segments and rotation deltas of the current sweep
+    TArray<FQuat> Rotations;
+    TArray<FQuat> Deltas;
+    Rotations.SetNum(SegmentCount);
+    Deltas.SetNum(SegmentCount);
+
+    // Warm start : continuing from the previous solution
+    if (InWarmStart && InCurrentState.Num() == SegmentCount + 1)
+    {
+        for (int32 i = 0; i < SegmentCount; i++)
+            Rotations[i] = InCurrentState[i].Rotation.Quaternion();
+    }
+
+    // Reinitiating state to match pole targets
+    else
+    {
+        FVector SegmentStart = InOriginLocation;
+        for (int32 i = 0; i < SegmentCount; i++)
+        {
+            const FVector Direction = (InPoleTargets[i] - SegmentStart).GetSafeNormal();
+            Rotations[i] = Direction.ToOrientationQuat();
+
+            SegmentStart += Direction * InSegments[i].Length;
+        }
+    }
+
+    State[0].Location = InOriginLocation;
+    for (int32 i = 0; i < SegmentCount; i++)
+        State[i + 1].Location = State[i].Location + Rotations[i].GetForwardVector() * InSegments[i].Length;
+
+    size_t Iteration = 0;
+    while ((Iteration < InMaxIterations) && ((State[SegmentCount].Location - InTargetLocation).Size() > InTollerance))
+    {
+        FVector TipLocation = State[SegmentCount].Location;
+
+        // Gauss-Seidel sweep (tip to root)
+        for (int32 i = SegmentCount - 1; i >= 0; i--)
+        {
+            const FVector& JointLocation = State[i].Location;
+
+            // Swing
+            const FVector ToTip = (TipLocation - JointLocation).GetSafeNormal();
+            const FVector ToTarget = (InTargetLocation - JointLocation).GetSafeNormal();
+
+            FVector SwingAxis;
+            float SwingAngle;
+            FQuat::FindBetweenNormals(ToTip, ToTarget).ToAxisAndAngle(SwingAxis, SwingAngle);
+
+            FQuat Delta = FQuat(SwingAxis, FMath::Min(SwingAngle * RelaxationFactor, UE_PI));
+
+            // Twist towards the pole target (the last segment's end is the tip itself, so it has nothing to twist)
+            if (i < SegmentCount - 1)
+            {
+                const FVector TwistAxis = Delta.RotateVector(TipLocation - JointLocation).GetSafeNormal();
+
+                const FVector NextJoint = FVector::VectorPlaneProject(Delta.RotateVector(State[i + 1].Location - JointLocation), TwistAxis);
+                const FVector PoleDirection = FVector::VectorPlaneProject(InPoleTargets[i] - JointLocation, TwistAxis);
+
+                if (!NextJoint.IsNearlyZero() && !PoleDirection.IsNearlyZero())
+                {
+                    const float TwistAngle = FMath::Atan2(FVector::DotProduct(FVector::CrossProduct(NextJoint, PoleDirection), TwistAxis), FVector::DotProduct(NextJoint, PoleDirection));
+                    Delta = FQuat(TwistAxis, TwistAngle) * Delta;
+                }
+            }
+
+            // Angular limits (the first segment is not limited, same as in other limited algorithms)
+            if (InApplyAngularLimits && i > 0)
+            {
+                const FQuat ClampedRotation = ClampRelativeSegmentRotation(Delta * Rotations[i], Rotations[i - 1], InSegments[i]);
+                Delta = ClampedRotation * Rotations[i].Inverse();
+            }
+
+            Deltas[i] = Delta;
+            TipLocation = JointLocation + Delta.RotateVector(TipLocation - JointLocation);
+        }
+
+        // Forward pass, accumulating deltas and rebuilding the chain
+        FQuat AccumulatedDelta = FQuat::Identity;
+        for (int32 i = 0; i < SegmentCount; i++)
+        {
+            AccumulatedDelta = AccumulatedDelta * Deltas[i];
+
+            Rotations[i] = (AccumulatedDelta * Rotations[i]).GetNormalized();
+            State[i + 1].Location = State[i].Location + Rotations[i].GetForwardVector() * InSegments[i].Length;
+        }
+
+        Iteration++;
+    }
+
+    for (int32 i = 0; i < SegmentCount; i++)
+        State[i].Rotation = Rotations[i].Rotator();
+
+    if (OutIterations)
+        *OutIterations = Iteration;
+
+    return State;
+}
 
 
 
@@ -717,6 +1766,50 @@ void UMPAS_Limb::RecalculateRoll(TArray<FMPAS_LimbSegmentState>& InOutState, flo
 }
 
 
+/*
+    Parallel transport : the first frame is built from the first segment's direction and the pole plane (up vector faces the first pole target),
+    every next frame is the previous one, rotated by the minimal rotation between the previous and the current segment direction.
+    The frames are twist-free along the chain, so the roll never flips, and only square roots are needed until the final Rotator conversion.
+*/
+void UMPAS_Limb::RecalculateRoll_ParallelTransport(TArray<FMPAS_LimbSegmentState>& InOutState, float InLimbRoll, const FVector& InOriginLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FVector>& InPoleTargets, const FVector& InUpVector)
+{
+    const int32 SegmentCount = InSegments.Num();
+    if (SegmentCount == 0 || InOutState.Num() != SegmentCount + 1)
+        return;
+
+    // Segment directions, taken from the solved locations (falling back to solved rotations for zero length segments)
+    auto GetSegmentDirection = [&InOutState](int32 InSegment)
+    {
+        const FVector Direction = (InOutState[InSegment + 1].Location - InOutState[InSegment].Location).GetSafeNormal();
+        return Direction.IsNearlyZero() ? InOutState[InSegment].Rotation.Vector() : Direction;
+    };
+
+    // First frame
+    FVector Direction = GetSegmentDirection(0);
+
+    FVector FrameUp = InPoleTargets.Num() > 0 ? FVector::VectorPlaneProject(InPoleTargets[0] - InOriginLocation, Direction).GetSafeNormal() : FVector::ZeroVector;
+    if (FrameUp.IsNearlyZero())
+        FrameUp = FVector::VectorPlaneProject(InUpVector, Direction).GetSafeNormal();
+
+    FQuat Frame = FRotationMatrix::MakeFromXZ(Direction, FrameUp).ToQuat();
+
+    // Additional roll is applied to every segment around it's own axis
+    const FQuat RollOffset = FQuat(FVector::ForwardVector, FMath::DegreesToRadians(InLimbRoll));
+
+    InOutState[0].Rotation = (Frame * RollOffset).Rotator();
+
+    // Transporting the frame along the chain
+    for (int32 i = 1; i < SegmentCount; i++)
+    {
+        const FVector NextDirection = GetSegmentDirection(i);
+
+        Frame = (FQuat::FindBetweenNormals(Direction, NextDirection) * Frame).GetNormalized();
+        Direction = NextDirection;
+
+        InOutState[i].Rotation = (Frame * RollOffset).Rotator();
+    }
+}
+
 
 // The point is space (World Space), which the limb is trying to reach
 FVector UMPAS_Limb::GetLimbTarget()
@@ -739,8 +1832,9 @@ FVector UMPAS_Limb::GetLimbTarget()
     }
 
     // Limit target to limb's max extent range
-    if ((Target - GetComponentLocation()).Size() > MaxExtent)
-        Target = GetComponentLocation() + (Target - GetComponentLocation()).GetSafeNormal() * MaxExtent;
+    const FVector Origin = GetComponentLocation();
+    if ((Target - Origin).SizeSquared() > MaxExtent * MaxExtent)
+        Target = Origin + (Target - Origin).GetSafeNormal() * MaxExtent;
 
     return Target;
 }
@@ -750,7 +1844,10 @@ FVector UMPAS_Limb::GetLimbTarget()
 void UMPAS_Limb::ReinitLimb()
 {
     Initialized = false;
-    Segments.Empty();
+    InvalidateSolveCache();
+    SolvePending = false;
+
+    // Segments are only cleared by the fetch (custom chain segments are user data)
     CurrentState.Empty();
 
     InitLimb();
@@ -825,7 +1922,17 @@ void UMPAS_Limb::UpdateRigElement(float DeltaTime)
     if (Initialized && GetRigElementActive())
     {
         InterpolateLimb(DeltaTime);
-        SolveLimb();
+
+        // Solving at a lower rate, if requested (interpolation keeps the limb moving in between)
+        TimeSinceLastSolve += DeltaTime;
+        if (TimeSinceLastSolve >= SolveInterval)
+        {
+            TimeSinceLastSolve = 0.f;
+            PrepareSolve();
+        }
+
+        if (EnableClearanceConstraint)
+            DispatchClearanceQueries();
     }
 }
 
@@ -839,6 +1946,10 @@ void UMPAS_Limb::SyncToFetchedBoneTransforms(float DeltaTime)
         {
             CurrentState[i].Location = (*BoneTransform).GetLocation();
             CurrentState[i].Rotation = (*BoneTransform).GetRotation().Rotator();
+
+            // Springs continue from the synchronized state
+            if (SpringRotations.IsValidIndex(i))
+                SpringRotations[i] = (*BoneTransform).GetRotation();
         }
     }
 }
@@ -880,4 +1991,118 @@ FVector UMPAS_Limb::ProjectLocationOnToSolutionPlane(const FVector& InLocation,
     FVector Projection = UKismetMathLibrary::ProjectVectorOnToPlane(InLocation - InLimbOrigin, PlaneNormal);
     
     return Projection + InLimbOrigin;
+}
+
+// Clamps segment's rotation relative to it's parent segment with segment's angular limits
+FQuat UMPAS_Limb::ClampRelativeSegmentRotation(const FQuat& InRotation, const FQuat& InParentRotation, const FMPAS_LimbSegmentData& InSegment)
+{
+    if (InSegment.AngularLimitModel == EMPAS_LimbAngularLimitModel::SwingTwist)
+        return InParentRotation * ClampSwingTwist(InParentRotation.Inverse() * InRotation, InSegment);
+
+    const FRotator RelativeRotation = (InParentRotation.Inverse() * InRotation).Rotator();
+
+    const FRotator ClampedRelativeRotation = FRotator(
+        UKismetMathLibrary::FClamp(RelativeRotation.Pitch, InSegment.AngularLimits_Min.Pitch, InSegment.AngularLimits_Max.Pitch),
+        UKismetMathLibrary::FClamp(RelativeRotation.Yaw, InSegment.AngularLimits_Min.Yaw, InSegment.AngularLimits_Max.Yaw),
+        UKismetMathLibrary::FClamp(RelativeRotation.Roll, InSegment.AngularLimits_Min.Roll, InSegment.AngularLimits_Max.Roll)
+    );
+
+    return InParentRotation * ClampedRelativeRotation.Quaternion();
+}
+
+/*
+    Relative rotation is decomposed as Swing * Twist, where twist is a rotation around segment's forward (X) axis.
+    Both parts are compared and clamped using their quaternion components directly, with the help of cached sines and cosines of half-limits:
+    - swing angle is within the cone if Swing.W >= cos(SwingLimit / 2)
+    - twist half-angle h = atan2(Twist.X, Twist.W) is below the min half-limit if sin(h - hmin) < 0, which expands into Twist.X * cos(hmin) - Twist.W * sin(hmin) < 0
+*/
+FQuat UMPAS_Limb::ClampSwingTwist(const FQuat& InRelativeRotation, const FMPAS_LimbSegmentData& InSegment)
+{
+    FQuat Swing, Twist;
+    InRelativeRotation.ToSwingTwist(FVector::ForwardVector, Swing, Twist);
+
+    // Making sure both quaternions represent the shortest rotation (W >= 0)
+    if (Swing.W < 0)
+        Swing = FQuat(-Swing.X, -Swing.Y, -Swing.Z, -Swing.W);
+
+    if (Twist.W < 0)
+        Twist = FQuat(-Twist.X, -Twist.Y, -Twist.Z, -Twist.W);
+
+    // Twist limits
+    if (Twist.X * InSegment.TwistLimit_HalfMinCos - Twist.W * InSegment.TwistLimit_HalfMinSin < 0)
+        Twist = FQuat(InSegment.TwistLimit_HalfMinSin, 0, 0, InSegment.TwistLimit_HalfMinCos);
+
+    else if (Twist.X * InSegment.TwistLimit_HalfMaxCos - Twist.W * InSegment.TwistLimit_HalfMaxSin > 0)
+        Twist = FQuat(InSegment.TwistLimit_HalfMaxSin, 0, 0, InSegment.TwistLimit_HalfMaxCos);
+
+    // Swing limit, keeping the swing axis and replacing the angle with the limit
+    if (Swing.W < InSegment.SwingLimit_HalfCos)
+    {
+        const FVector SwingAxis = FVector(Swing.X, Swing.Y, Swing.Z).GetSafeNormal();
+        Swing = FQuat(SwingAxis.X * InSegment.SwingLimit_HalfSin, SwingAxis.Y * InSegment.SwingLimit_HalfSin, SwingAxis.Z * InSegment.SwingLimit_HalfSin, InSegment.SwingLimit_HalfCos);
+    }
+
+    return Swing * Twist;
+}
+
+// Clamps segment's direction to the swing cone around parent's direction (both directions must be normalized)
+FVector UMPAS_Limb::ClampSegmentDirection(const FVector& InDirection, const FVector& InParentDirection, const FMPAS_LimbSegmentData& InSegment)
+{
+    const float CosAngle = FVector::DotProduct(InDirection, InParentDirection);
+
+    if (CosAngle >= InSegment.SwingLimit_Cos)
+        return InDirection;
+
+    // Moving the direction on to the edge of the cone, in the plane of both directions
+    FVector Perpendicular = (InDirection - InParentDirection * CosAngle).GetSafeNormal();
+
+    // Direction is exactly opposite to the parent, any side of the cone will do
+    if (Perpendicular.IsNearlyZero())
+    {
+        FVector AxisZ;
+        InParentDirection.FindBestAxisVectors(Perpendicular, AxisZ);
+    }
+
+    return InParentDirection * InSegment.SwingLimit_Cos + Perpendicular * InSegment.SwingLimit_Sin;
+}
+
+// Moves inner joints by the corrections of their adjacent segments, then restores segment lengths with a single FABRIK iteration towards the solved tip
+void UMPAS_Limb::ApplyClearanceCorrections(TArray<FMPAS_LimbSegmentState>& InOutState, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FVector>& InCorrections)
+{
+    const int32 N = InSegments.Num();
+    if (N < 2)
+        return;
+
+    // Directions before the correction, used to keep segment roll
+    TArray<FVector, TInlineAllocator<16>> OldDirections;
+    OldDirections.SetNumUninitialized(N);
+    for (int32 i = 0; i < N; i++)
+        OldDirections[i] = (InOutState[i + 1].Location - InOutState[i].Location).GetSafeNormal();
+
+    const FVector L_Origin = InOutState[0].Location;
+
+    // Inner joints are shared by two segments
+    for (int32 i = 1; i < N; i++)
+        InOutState[i].Location += (InCorrections[i - 1] + InCorrections[i]) * 0.5f;
+
+    // Forward-Reaching pass (starting from the solved tip)
+    for (int32 i = N; i > 0; i--)
+    {
+        const FVector DirectionVector = (InOutState[i - 1].Location - InOutState[i].Location).GetSafeNormal();
+        InOutState[i - 1].Location = InOutState[i].Location + DirectionVector * InSegments[i - 1].Length;
+    }
+
+    // Backward-Reaching pass
+    InOutState[0].Location = L_Origin;
+    for (int32 i = 0; i < N; i++)
+    {
+        const FVector DirectionVector = (InOutState[i + 1].Location - InOutState[i].Location).GetSafeNormal();
+        InOutState[i + 1].Location = InOutState[i].Location + DirectionVector * InSegments[i].Length;
+
+        // Rotating segments by the change of their direction
+        if (!OldDirections[i].IsZero() && !DirectionVector.IsZero())
+            InOutState[i].Rotation = (FQuat::FindBetweenNormals(OldDirections[i], DirectionVector) * InOutState[i].Rotation.Quaternion()).Rotator();
+    }
+
+    InOutState[N].Rotation = InOutState[N - 1].Rotation;
 }
\ No newline at end of file
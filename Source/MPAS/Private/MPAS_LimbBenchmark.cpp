@@ -0,0 +1,266 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MPAS_LimbBenchmark.h"
+#include "HAL/IConsoleManager.h"
+
+
+// Benchmarking is a development tool, shipping builds only keep empty functions for the Blueprint library
+#if !UE_BUILD_SHIPPING
+
+// Console command, that runs the full benchmark and prints the results (works in headless -nullrhi runs)
+static FAutoConsoleCommandWithArgsAndOutputDevice GMPAS_BenchmarkLimbSolversCommand(
+	TEXT("MPAS.BenchmarkLimbSolvers"),
+	TEXT("Benchmarks all limb solving algorithms. Arguments: [TargetsPerSet=256] [MaxIterations=32] [Tollerance=1] [Seed=0]"),
+	FConsoleCommandWithArgsAndOutputDeviceDelegate::CreateLambda([](const TArray<FString>& Args, FOutputDevice& Ar)
+	{
+		const int32 TargetsPerSet = Args.IsValidIndex(0) ? FCString::Atoi(*Args[0]) : 256;
+		const int32 MaxIterations = Args.IsValidIndex(1) ? FCString::Atoi(*Args[1]) : 32;
+		const float Tollerance = Args.IsValidIndex(2) ? FCString::Atof(*Args[2]) : 1.f;
+		const int32 Seed = Args.IsValidIndex(3) ? FCString::Atoi(*Args[3]) : 0;
+
+		const TArray<FMPAS_LimbBenchmarkResult> Results = UMPAS_LimbBenchmarkLibrary::BenchmarkLimbSolvers(TargetsPerSet, MaxIterations, Tollerance, Seed);
+
+		TArray<FString> Lines;
+		UMPAS_LimbBenchmarkLibrary::FormatBenchmarkResults(Results).ParseIntoArrayLines(Lines);
+
+		for (const FString& Line : Lines)
+			Ar.Log(Line);
+	})
+);
+
+
+// Runs every solving algorithm over every target set for chains of 2, 3, 4, 6, 16 and 64 segments with every roll recalculation mode (cold starts, same seed - same targets)
+TArray<FMPAS_LimbBenchmarkResult> UMPAS_LimbBenchmarkLibrary::BenchmarkLimbSolvers(int32 InTargetsPerSet, int32 InMaxIterations, float InTollerance, int32 InSeed)
+{
+	TArray<FMPAS_LimbBenchmarkResult> Results;
+
+	// 2, 3, 4 and 6 segments use specialized kernels (where available), 16 and 64 segments use the generic solvers (64 - long tentacle-like chains)
+	const int32 SegmentCounts[] = { 2, 3, 4, 6, 16, 64 };
+
+	const UEnum* AlgorithmEnum = StaticEnum<EMPAS_LimbSolvingAlgorithm>();
+	const UEnum* TargetSetEnum = StaticEnum<EMPAS_LimbBenchmarkTargetSet>();
+	const UEnum* RollModeEnum = StaticEnum<EMPAS_LimbRollRecalculationMode>();
+
+	for (int32 SegmentCount : SegmentCounts)
+		for (int32 SetIndex = 0; SetIndex < TargetSetEnum->NumEnums() - 1; SetIndex++)
+			for (int32 AlgorithmIndex = 0; AlgorithmIndex < AlgorithmEnum->NumEnums() - 1; AlgorithmIndex++)
+				for (int32 RollModeIndex = 0; RollModeIndex < RollModeEnum->NumEnums() - 1; RollModeIndex++)
+				{
+					const EMPAS_LimbSolvingAlgorithm Algorithm = (EMPAS_LimbSolvingAlgorithm)AlgorithmEnum->GetValueByIndex(AlgorithmIndex);
+					const EMPAS_LimbBenchmarkTargetSet TargetSet = (EMPAS_LimbBenchmarkTargetSet)TargetSetEnum->GetValueByIndex(SetIndex);
+					const EMPAS_LimbRollRecalculationMode RollMode = (EMPAS_LimbRollRecalculationMode)RollModeEnum->GetValueByIndex(RollModeIndex);
+
+					Results.Add(BenchmarkLimbSolver(Algorithm, TargetSet, SegmentCount, InTargetsPerSet, InMaxIterations, InTollerance, InSeed, RollMode));
+				}
+
+	return Results;
+}
+
+// Runs a single algorithm over a single generated target set, recalculating roll with the given mode (roll mode doesn't affect the generated targets)
+FMPAS_LimbBenchmarkResult UMPAS_LimbBenchmarkLibrary::BenchmarkLimbSolver(EMPAS_LimbSolvingAlgorithm InAlgorithm, EMPAS_LimbBenchmarkTargetSet InTargetSet, int32 InSegmentCount, int32 InTargetsPerSet, int32 InMaxIterations, float InTollerance, int32 InSeed, EMPAS_LimbRollRecalculationMode InRollRecalculationMode)
+{
+	FMPAS_LimbBenchmarkResult Result;
+	Result.Algorithm = InAlgorithm;
+	Result.TargetSet = InTargetSet;
+	Result.SegmentCount = InSegmentCount;
+	Result.RollRecalculationMode = InRollRecalculationMode;
+
+	if (InSegmentCount < 2 || InTargetsPerSet <= 0)
+		return Result;
+
+	// Same seed and segment count always generate the same chain and targets, regardless of the algorithm
+	FRandomStream Stream(InSeed * 7919 + InSegmentCount * 31 + (int32)InTargetSet);
+
+	// Generating the chain
+	TArray<FMPAS_LimbSegmentData> Segments;
+	float MaxExtent = 0.f;
+
+	for (int32 i = 0; i < InSegmentCount; i++)
+	{
+		FMPAS_LimbSegmentData Segment;
+		Segment.Length = Stream.FRandRange(20.f, 60.f);
+
+		if (InTargetSet == EMPAS_LimbBenchmarkTargetSet::Limited)
+		{
+			Segment.AngularLimitModel = EMPAS_LimbAngularLimitModel::SwingTwist;
+			Segment.SwingLimit = 60.f;
+			Segment.TwistLimit_Min = -30.f;
+			Segment.TwistLimit_Max = 30.f;
+		}
+
+		Segment.CacheSwingTwistLimits();
+
+		MaxExtent += Segment.Length;
+		Segments.Add(Segment);
+	}
+
+	// Straight up initial state, every solve starts from it
+	TArray<FMPAS_LimbSegmentState> InitialState;
+	InitialState.SetNum(InSegmentCount + 1);
+
+	FVector Location = FVector::ZeroVector;
+	for (int32 i = 0; i <= InSegmentCount; i++)
+	{
+		InitialState[i].Location = Location;
+		InitialState[i].Rotation = FVector::UpVector.Rotation();
+
+		if (i < InSegmentCount)
+			Location += FVector::UpVector * Segments[i].Length;
+	}
+
+	// Generating targets and pole targets (a single pole target is shared by all segments, like in UMPAS_Limb::GatherSolveInput)
+	TArray<FMPAS_LimbSolveInput> Inputs;
+	Inputs.SetNum(InTargetsPerSet);
+
+	for (FMPAS_LimbSolveInput& Input : Inputs)
+	{
+		const float Distance = (InTargetSet == EMPAS_LimbBenchmarkTargetSet::Unreachable) ? Stream.FRandRange(1.1f, 1.5f) * MaxExtent : Stream.FRandRange(0.2f, 0.95f) * MaxExtent;
+
+		Input.OriginLocation = FVector::ZeroVector;
+		Input.TargetLocation = Stream.GetUnitVector() * Distance;
+		Input.UpVector = FVector::UpVector;
+
+		const FVector PoleTarget = Input.TargetLocation * 0.5f + (Stream.GetUnitVector() + FVector::UpVector) * MaxExtent * 0.5f;
+		Input.PoleTargets.Init(PoleTarget, InSegmentCount);
+	}
+
+	const FMPAS_LimbSolverKernels Kernels = UMPAS_Limb::SelectSolverKernels(InSegmentCount);
+
+	// Measuring
+	uint64 TotalCycles = 0;
+	int64 TotalIterations = 0;
+	double TotalError = 0.0;
+	int32 ConvergedCount = 0;
+
+	for (const FMPAS_LimbSolveInput& Input : Inputs)
+	{
+		bool Converged = false;
+		int32 Iterations = 0;
+		float Error = 0.f;
+
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+
+		const TArray<FMPAS_LimbSegmentState> State = UMPAS_Limb::ExecuteSolvingAlgorithm(InAlgorithm, Input, Segments, InitialState, InMaxIterations, InTollerance, MaxExtent, false, true, 0.f, InRollRecalculationMode, Kernels, Converged, Iterations, Error);
+
+		TotalCycles += FPlatformTime::Cycles64() - StartCycles;
+
+		// Limit violations are measured outside of the timed section
+		if (InTargetSet == EMPAS_LimbBenchmarkTargetSet::Limited)
+		{
+			float SwingViolation = 0.f;
+			float TwistViolation = 0.f;
+			MeasureLimitViolations(State, Segments, SwingViolation, TwistViolation);
+
+			Result.MaxSwingLimitViolation = FMath::Max(Result.MaxSwingLimitViolation, SwingViolation);
+			Result.MaxTwistLimitViolation = FMath::Max(Result.MaxTwistLimitViolation, TwistViolation);
+		}
+
+		TotalIterations += Iterations;
+		TotalError += Error;
+		Result.MaxError = FMath::Max(Result.MaxError, Error);
+
+		if (Converged)
+			ConvergedCount++;
+	}
+
+	Result.AverageSolveTimeNs = (float)(FPlatformTime::ToSeconds64(TotalCycles) * 1e9 / InTargetsPerSet);
+	Result.AverageIterations = (float)TotalIterations / InTargetsPerSet;
+	Result.AverageError = (float)(TotalError / InTargetsPerSet);
+	Result.ConvergedRatio = (float)ConvergedCount / InTargetsPerSet;
+
+	return Result;
+}
+
+// Largest swing and twist limit violations (in degrees) of a solved state, relative to the parent segments
+void UMPAS_LimbBenchmarkLibrary::MeasureLimitViolations(const TArray<FMPAS_LimbSegmentState>& InState, const TArray<FMPAS_LimbSegmentData>& InSegments, float& OutSwingViolation, float& OutTwistViolation)
+{
+	OutSwingViolation = 0.f;
+	OutTwistViolation = 0.f;
+
+	if (InState.Num() != InSegments.Num() + 1)
+		return;
+
+	for (int32 i = 1; i < InSegments.Num(); i++)
+	{
+		const FMPAS_LimbSegmentData& Segment = InSegments[i];
+		if (Segment.AngularLimitModel != EMPAS_LimbAngularLimitModel::SwingTwist)
+			continue;
+
+		// Swing is measured between segment directions (the same way the solvers clamp it), so it doesn't depend on roll recalculation
+		const FVector ParentDirection = (InState[i].Location - InState[i - 1].Location).GetSafeNormal();
+		const FVector Direction = (InState[i + 1].Location - InState[i].Location).GetSafeNormal();
+
+		const float SwingAngle = FMath::RadiansToDegrees(FMath::Acos(FMath::Clamp(FVector::DotProduct(ParentDirection, Direction), -1.f, 1.f)));
+		OutSwingViolation = FMath::Max(OutSwingViolation, SwingAngle - Segment.SwingLimit);
+
+		// Twist is measured around segment's forward axis, relative to the parent segment's rotation
+		FQuat Swing, Twist;
+		(InState[i - 1].Rotation.Quaternion().Inverse() * InState[i].Rotation.Quaternion()).ToSwingTwist(FVector::ForwardVector, Swing, Twist);
+
+		if (Twist.W < 0)
+			Twist = FQuat(-Twist.X, -Twist.Y, -Twist.Z, -Twist.W);
+
+		const float TwistAngle = FMath::RadiansToDegrees(2.f * FMath::Atan2(Twist.X, Twist.W));
+		OutTwistViolation = FMath::Max(OutTwistViolation, FMath::Max(Segment.TwistLimit_Min - TwistAngle, TwistAngle - Segment.TwistLimit_Max));
+	}
+}
+
+// Formats benchmark results as a table, one line per result
+FString UMPAS_LimbBenchmarkLibrary::FormatBenchmarkResults(const TArray<FMPAS_LimbBenchmarkResult>& InResults)
+{
+	const UEnum* AlgorithmEnum = StaticEnum<EMPAS_LimbSolvingAlgorithm>();
+	const UEnum* TargetSetEnum = StaticEnum<EMPAS_LimbBenchmarkTargetSet>();
+	const UEnum* RollModeEnum = StaticEnum<EMPAS_LimbRollRecalculationMode>();
+
+	FString Table = FString::Printf(TEXT("%-24s %-9s %-12s %-18s %12s %11s %11s %11s %10s %10s %10s\n"), TEXT("Algorithm"), TEXT("Segments"), TEXT("TargetSet"), TEXT("RollMode"), TEXT("ns/solve"), TEXT("Iterations"), TEXT("AvgError"), TEXT("MaxError"), TEXT("Converged"), TEXT("SwingViol"), TEXT("TwistViol"));
+
+	for (const FMPAS_LimbBenchmarkResult& Result : InResults)
+	{
+		Table += FString::Printf(TEXT("%-24s %-9d %-12s %-18s %12.1f %11.2f %11.3f %11.3f %9.1f%% %10.2f %10.2f\n"),
+			*AlgorithmEnum->GetNameStringByValue((int64)Result.Algorithm),
+			Result.SegmentCount,
+			*TargetSetEnum->GetNameStringByValue((int64)Result.TargetSet),
+			*RollModeEnum->GetNameStringByValue((int64)Result.RollRecalculationMode),
+			Result.AverageSolveTimeNs,
+			Result.AverageIterations,
+			Result.AverageError,
+			Result.MaxError,
+			Result.ConvergedRatio * 100.f,
+			Result.MaxSwingLimitViolation,
+			Result.MaxTwistLimitViolation);
+	}
+
+	return Table;
+}
+
+#else
+
+TArray<FMPAS_LimbBenchmarkResult> UMPAS_LimbBenchmarkLibrary::BenchmarkLimbSolvers(int32 InTargetsPerSet, int32 InMaxIterations, float InTollerance, int32 InSeed)
+{
+	return TArray<FMPAS_LimbBenchmarkResult>();
+}
+
+FMPAS_LimbBenchmarkResult UMPAS_LimbBenchmarkLibrary::BenchmarkLimbSolver(EMPAS_LimbSolvingAlgorithm InAlgorithm, EMPAS_LimbBenchmarkTargetSet InTargetSet, int32 InSegmentCount, int32 InTargetsPerSet, int32 InMaxIterations, float InTollerance, int32 InSeed, EMPAS_LimbRollRecalculationMode InRollRecalculationMode)
+{
+	FMPAS_LimbBenchmarkResult Result;
+	Result.Algorithm = InAlgorithm;
+	Result.TargetSet = InTargetSet;
+	Result.SegmentCount = InSegmentCount;
+	Result.RollRecalculationMode = InRollRecalculationMode;
+
+	return Result;
+}
+
+void UMPAS_LimbBenchmarkLibrary::MeasureLimitViolations(const TArray<FMPAS_LimbSegmentState>& InState, const TArray<FMPAS_LimbSegmentData>& InSegments, float& OutSwingViolation, float& OutTwistViolation)
+{
+	OutSwingViolation = 0.f;
+	OutTwistViolation = 0.f;
+}
+
+FString UMPAS_LimbBenchmarkLibrary::FormatBenchmarkResults(const TArray<FMPAS_LimbBenchmarkResult>& InResults)
+{
+	return FString();
+}
+
+#endif
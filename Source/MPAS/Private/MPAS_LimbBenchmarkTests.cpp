@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MPAS_LimbBenchmark.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace MPAS_LimbBenchmarkTests
+{
+	// Same settings for every test, so the seeded target sets stay the same
+	const int32 SegmentCounts[] = { 2, 3, 4, 6, 16, 64 };
+	const int32 TargetsPerSet = 64;
+	const int32 MaxIterations = 32;
+	const float Tollerance = 1.f;
+	const int32 Seed = 0;
+
+	// Iterative algorithms, that have to reach targets within limb's max extent (unlimited segments), with their minimal converged ratio and maximal average error
+	struct FAccuracyThreshold
+	{
+		EMPAS_LimbSolvingAlgorithm Algorithm;
+		float MinConvergedRatio;
+		float MaxAverageError;
+	};
+
+	// Reachable sets can contain a few targets closer to the origin than a 2 segment chain can fold, so the ratios are not 1
+	// CCD only rotates one joint at a time towards the target, so for targets near full extension (up to 0.95 of max extent) it's error shrinks
+	// by a small fraction per sweep and a part of them ends a few units short of the 1 unit tollerance after 32 iterations, hence the looser gate
+	const FAccuracyThreshold AccuracyThresholds[] =
+	{
+		{ EMPAS_LimbSolvingAlgorithm::FABRIK_IK, 0.8f, 5.f },
+		{ EMPAS_LimbSolvingAlgorithm::FABRIK_Limited_IK, 0.8f, 5.f },
+		{ EMPAS_LimbSolvingAlgorithm::PoleFABRIK_IK, 0.8f, 5.f },
+		{ EMPAS_LimbSolvingAlgorithm::PoleFABRIK_Limited_IK, 0.8f, 5.f },
+		{ EMPAS_LimbSolvingAlgorithm::Gauss_Seidel, 0.8f, 5.f },
+		{ EMPAS_LimbSolvingAlgorithm::Gauss_Seidel_Limited, 0.8f, 5.f },
+		{ EMPAS_LimbSolvingAlgorithm::CCD_IK, 0.6f, 10.f },
+		{ EMPAS_LimbSolvingAlgorithm::CCD_Limited_IK, 0.6f, 10.f }
+	};
+
+	// Algorithms, that apply angular limits of the segments, have to keep every segment within it's swing cone
+	// Twist is set by roll recalculation after the solve (not by the solvers), so it is reported by the benchmark, but not gated
+	const EMPAS_LimbSolvingAlgorithm LimitedAlgorithms[] =
+	{
+		EMPAS_LimbSolvingAlgorithm::FABRIK_Limited_IK,
+		EMPAS_LimbSolvingAlgorithm::PoleFABRIK_Limited_IK,
+		EMPAS_LimbSolvingAlgorithm::Gauss_Seidel_Limited,
+		EMPAS_LimbSolvingAlgorithm::CCD_Limited_IK
+	};
+
+	// Maximal swing limit violation (in degrees), only covers numerical error
+	const float MaxSwingLimitViolation = 1.f;
+
+	// Whether all measured values are finite numbers
+	bool IsResultFinite(const FMPAS_LimbBenchmarkResult& InResult)
+	{
+		return FMath::IsFinite(InResult.AverageError) && FMath::IsFinite(InResult.MaxError) && FMath::IsFinite(InResult.AverageIterations) && FMath::IsFinite(InResult.MaxSwingLimitViolation) && FMath::IsFinite(InResult.MaxTwistLimitViolation);
+	}
+
+	// Readable description of a result for test messages
+	FString DescribeResult(const FMPAS_LimbBenchmarkResult& InResult)
+	{
+		return FString::Printf(TEXT("%s, %d segments, %s, %s"),
+			*StaticEnum<EMPAS_LimbSolvingAlgorithm>()->GetNameStringByValue((int64)InResult.Algorithm),
+			InResult.SegmentCount,
+			*StaticEnum<EMPAS_LimbBenchmarkTargetSet>()->GetNameStringByValue((int64)InResult.TargetSet),
+			*StaticEnum<EMPAS_LimbRollRecalculationMode>()->GetNameStringByValue((int64)InResult.RollRecalculationMode));
+	}
+}
+
+
+// Iterative solvers have to converge on reachable targets
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMPAS_LimbSolversReachableTest, "MPAS.Limb.Solvers.Reachable", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FMPAS_LimbSolversReachableTest::RunTest(const FString& Parameters)
+{
+	using namespace MPAS_LimbBenchmarkTests;
+
+	for (const FAccuracyThreshold& Threshold : AccuracyThresholds)
+		for (int32 SegmentCount : SegmentCounts)
+		{
+			const FMPAS_LimbBenchmarkResult Result = UMPAS_LimbBenchmarkLibrary::BenchmarkLimbSolver(Threshold.Algorithm, EMPAS_LimbBenchmarkTargetSet::Reachable, SegmentCount, TargetsPerSet, MaxIterations, Tollerance, Seed);
+			const FString Description = DescribeResult(Result);
+
+			TestTrue(FString::Printf(TEXT("%s : results are finite"), *Description), IsResultFinite(Result));
+			TestTrue(FString::Printf(TEXT("%s : converged ratio %.2f >= %.2f"), *Description, Result.ConvergedRatio, Threshold.MinConvergedRatio), Result.ConvergedRatio >= Threshold.MinConvergedRatio);
+			TestTrue(FString::Printf(TEXT("%s : average error %.3f <= %.3f"), *Description, Result.AverageError, Threshold.MaxAverageError), Result.AverageError <= Threshold.MaxAverageError);
+			TestTrue(FString::Printf(TEXT("%s : iterations %.2f <= %d"), *Description, Result.AverageIterations, MaxIterations), Result.AverageIterations <= MaxIterations);
+		}
+
+	return true;
+}
+
+
+// Targets beyond the max extent can't be reached, a solver reporting convergence on them is broken
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMPAS_LimbSolversUnreachableTest, "MPAS.Limb.Solvers.Unreachable", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FMPAS_LimbSolversUnreachableTest::RunTest(const FString& Parameters)
+{
+	using namespace MPAS_LimbBenchmarkTests;
+
+	for (const FAccuracyThreshold& Threshold : AccuracyThresholds)
+		for (int32 SegmentCount : SegmentCounts)
+		{
+			const FMPAS_LimbBenchmarkResult Result = UMPAS_LimbBenchmarkLibrary::BenchmarkLimbSolver(Threshold.Algorithm, EMPAS_LimbBenchmarkTargetSet::Unreachable, SegmentCount, TargetsPerSet, MaxIterations, Tollerance, Seed);
+			const FString Description = DescribeResult(Result);
+
+			TestTrue(FString::Printf(TEXT("%s : results are finite"), *Description), IsResultFinite(Result));
+			TestEqual(FString::Printf(TEXT("%s : converged ratio"), *Description), Result.ConvergedRatio, 0.f);
+			TestTrue(FString::Printf(TEXT("%s : average error %.3f > %.3f"), *Description, Result.AverageError, Tollerance), Result.AverageError > Tollerance);
+		}
+
+	return true;
+}
+
+
+// Every algorithm has to produce finite results on limited segments with every roll recalculation mode, limited algorithms have to respect swing limits, and the same seed has to reproduce the same measurements
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMPAS_LimbSolversLimitedTest, "MPAS.Limb.Solvers.LimitedAndReproducible", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FMPAS_LimbSolversLimitedTest::RunTest(const FString& Parameters)
+{
+	using namespace MPAS_LimbBenchmarkTests;
+
+	const UEnum* AlgorithmEnum = StaticEnum<EMPAS_LimbSolvingAlgorithm>();
+	const UEnum* RollModeEnum = StaticEnum<EMPAS_LimbRollRecalculationMode>();
+
+	for (int32 AlgorithmIndex = 0; AlgorithmIndex < AlgorithmEnum->NumEnums() - 1; AlgorithmIndex++)
+		for (int32 RollModeIndex = 0; RollModeIndex < RollModeEnum->NumEnums() - 1; RollModeIndex++)
+			for (int32 SegmentCount : SegmentCounts)
+			{
+				const EMPAS_LimbSolvingAlgorithm Algorithm = (EMPAS_LimbSolvingAlgorithm)AlgorithmEnum->GetValueByIndex(AlgorithmIndex);
+				const EMPAS_LimbRollRecalculationMode RollMode = (EMPAS_LimbRollRecalculationMode)RollModeEnum->GetValueByIndex(RollModeIndex);
+
+				const FMPAS_LimbBenchmarkResult Result = UMPAS_LimbBenchmarkLibrary::BenchmarkLimbSolver(Algorithm, EMPAS_LimbBenchmarkTargetSet::Limited, SegmentCount, TargetsPerSet, MaxIterations, Tollerance, Seed, RollMode);
+				const FMPAS_LimbBenchmarkResult Repeated = UMPAS_LimbBenchmarkLibrary::BenchmarkLimbSolver(Algorithm, EMPAS_LimbBenchmarkTargetSet::Limited, SegmentCount, TargetsPerSet, MaxIterations, Tollerance, Seed, RollMode);
+				const FString Description = DescribeResult(Result);
+
+				TestTrue(FString::Printf(TEXT("%s : results are finite"), *Description), IsResultFinite(Result));
+
+				if (MakeArrayView(LimitedAlgorithms).Contains(Algorithm))
+					TestTrue(FString::Printf(TEXT("%s : swing limit violation %.2f <= %.2f"), *Description, Result.MaxSwingLimitViolation, MaxSwingLimitViolation), Result.MaxSwingLimitViolation <= MaxSwingLimitViolation);
+
+				TestEqual(FString::Printf(TEXT("%s : reproduced average error"), *Description), Repeated.AverageError, Result.AverageError);
+				TestEqual(FString::Printf(TEXT("%s : reproduced average iterations"), *Description), Repeated.AverageIterations, Result.AverageIterations);
+				TestEqual(FString::Printf(TEXT("%s : reproduced converged ratio"), *Description), Repeated.ConvergedRatio, Result.ConvergedRatio);
+			}
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,88 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Default/RigElements/MPAS_Piston.h"
+#include "MPAS_Handler.h"
+
+// Constructor
+UMPAS_Piston::UMPAS_Piston() : TargetComponent(nullptr) {}
+
+
+// The point is space (World Space), which the piston is trying to reach
+FVector UMPAS_Piston::GetPistonTarget()
+{
+    switch (TargetType)
+    {
+
+    case EMPAS_LimbTargetType::FirstChildComponent:
+        if (TargetComponent)
+            return TargetComponent->GetComponentLocation();
+        break;
+
+    case EMPAS_LimbTargetType::TargetVectorStack:
+        return CalculateVectorStackValue(TargetStackID);
+
+    default: break;
+    }
+
+    return GetComponentLocation();
+}
+
+// Sum of the lengths of all stages
+float UMPAS_Piston::GetMaxExtent()
+{
+    float Extent = 0.f;
+    for (const FMPAS_PistonStage& Stage : Stages)
+        Extent += Stage.Length;
+
+    return Extent;
+}
+
+// Location of the given stage after the latest handler update (World Space)
+FVector UMPAS_Piston::GetStageLocation(int32 InStage)
+{
+    if (PistonIndex == -1 || !GetHandler())
+        return GetComponentLocation();
+
+    const FMPAS_PistonBatch& Batch = GetHandler()->GetPistonBatch();
+    if (!Batch.StageCounts.IsValidIndex(PistonIndex) || InStage < 0 || InStage >= Batch.StageCounts[PistonIndex])
+        return GetComponentLocation();
+
+    return Batch.StageLocations[Batch.StageOffsets[PistonIndex] + InStage];
+}
+
+
+// CALLED BY THE HANDLER : Initializing Rig Element
+void UMPAS_Piston::InitRigElement(class UMPAS_Handler* InHandler)
+{
+    Super::InitRigElement(InHandler);
+
+    if (TargetType == EMPAS_LimbTargetType::TargetVectorStack)
+        TargetStackID = RegisterVectorStack("PistonTarget");
+}
+
+// CALLED BY THE HANDLER : Contains the logic that links this element with other elements in the rig
+void UMPAS_Piston::LinkRigElement(class UMPAS_Handler* InHandler)
+{
+    Super::LinkRigElement(InHandler);
+
+    if (TargetType == EMPAS_LimbTargetType::FirstChildComponent)
+    {
+        if (GetHandler()->GetRigData()[RigElementName].ChildElements.Num() > 0)
+            TargetComponent = GetHandler()->GetRigData()[GetHandler()->GetRigData()[RigElementName].ChildElements[0]].RigElement;
+    }
+}
+
+// CALLED BY THE HANDLER : Updating Rig Element every tick
+void UMPAS_Piston::UpdateRigElement(float DeltaTime)
+{
+    Super::UpdateRigElement(DeltaTime);
+
+    if (IsCoreElement) return;
+
+    SetWorldRotation(FRotator::ZeroRotator);
+
+    // Submitting inputs, the piston is extended by the handler together with the rest of the pistons in the rig
+    if (PistonIndex != -1 && GetRigElementActive())
+        GetHandler()->SetPistonInput(PistonIndex, GetComponentLocation(), GetPistonTarget(), GetUpVector());
+}
@@ -154,6 +154,9 @@ void UMPAS_RigElement::UpdateRigElement(float DeltaTime)
 	OnUpdateRigElement(DeltaTime);
 }
 
+// CALLED BY THE HANDLER : Called every tick after all rig elements were updated (desired transforms of all elements are final)
+void UMPAS_RigElement::PostUpdateRigElement(float DeltaTime) {}
+
 // CALLED BY THE HANDLER : Synchronizes Rig Element to the most recently fetched bone transforms
 void UMPAS_RigElement::SyncToFetchedBoneTransforms(float DeltaTime)
 {
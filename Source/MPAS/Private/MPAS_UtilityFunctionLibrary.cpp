@@ -2,10 +2,23 @@
 
 
 #include "MPAS_UtilityFunctionLibrary.h"
+#include "MPAS_Handler.h"
 
 // A wrapper around LineTraceByChannel that can be called from direct objects descendants in Blueprints
 bool UMPAS_UtilityFunctionLibrary::RawObjectLineTraceByChannel(AActor* ContextActor, FHitResult& OutHit, const FVector& Start, const FVector& End, ECollisionChannel TraceChannel)
 {
 	if (!ContextActor) return false;
 	return ContextActor->GetWorld()->LineTraceSingleByChannel(OutHit, Start, End, TraceChannel);
+}
+
+// Looks for the ground, using the ground query backend of the context actor's MPAS handler (a line trace, if the actor has no handler)
+bool UMPAS_UtilityFunctionLibrary::RawObjectGroundQuery(AActor* ContextActor, FHitResult& OutHit, const FVector& Start, const FVector& End, ECollisionChannel TraceChannel)
+{
+	if (!ContextActor) return false;
+
+	UMPAS_Handler* Handler = ContextActor->FindComponentByClass<UMPAS_Handler>();
+	if (Handler)
+		return Handler->QueryGround(Start, End, OutHit, TraceChannel);
+
+	return ContextActor->GetWorld()->LineTraceSingleByChannel(OutHit, Start, End, TraceChannel);
 }
\ No newline at end of file
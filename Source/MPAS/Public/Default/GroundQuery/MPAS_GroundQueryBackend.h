@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Engine/EngineTypes.h"
+#include "CollisionQueryParams.h"
+#include "MPAS_GroundQueryBackend.generated.h"
+
+
+/**
+ * Finds the ground between two points for foot placement (legs, crawlers, intention drivers)
+ * Selected per handler (UMPAS_Handler::GroundQueryBackend), if no backend is selected physics traces are used
+ */
+UCLASS(Abstract, Blueprintable, EditInlineNew, DefaultToInstanced, CollapseCategories)
+class MPAS_API UMPAS_GroundQueryBackend : public UObject
+{
+	GENERATED_BODY()
+
+public:
+
+	/*
+	 * Looks for the ground on the segment from InStart to InEnd (normally vertical, from top to bottom)
+	 * Fills Location, ImpactPoint, ImpactNormal and bBlockingHit of OutHit, returns whether the ground was found
+	 */
+	virtual bool QueryGround(UWorld* InWorld, const FVector& InStart, const FVector& InEnd, ECollisionChannel InChannel, const FCollisionQueryParams& InQueryParams, FHitResult& OutHit) { return false; }
+
+	// Whether queries of this backend are physics traces, which can be batched and performed asynchronously by the handler
+	virtual bool SupportsAsyncQueries() const { return false; }
+};
+
+
+/**
+ * Physics line traces (same as having no backend, but allows overriding the collision channel)
+ */
+UCLASS(meta=(DisplayName="Physics Trace"))
+class MPAS_API UMPAS_PhysicsGroundQueryBackend : public UMPAS_GroundQueryBackend
+{
+	GENERATED_BODY()
+
+public:
+
+	// Whether Channel is used instead of the channel, requested by the caller
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Default|GroundQuery")
+	bool OverrideChannel = false;
+
+	// Collision channel of the traces, if OverrideChannel is set
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Default|GroundQuery", meta=(EditCondition="OverrideChannel"))
+	TEnumAsByte<ECollisionChannel> Channel = ECC_Visibility;
+
+	virtual bool QueryGround(UWorld* InWorld, const FVector& InStart, const FVector& InEnd, ECollisionChannel InChannel, const FCollisionQueryParams& InQueryParams, FHitResult& OutHit) override;
+
+	virtual bool SupportsAsyncQueries() const override { return !OverrideChannel; }
+};
+
+
+/**
+ * Samples heightfields of the landscapes in the world, no collision is involved (anything except for landscapes is ignored)
+ */
+UCLASS(meta=(DisplayName="Landscape Height"))
+class MPAS_API UMPAS_LandscapeGroundQueryBackend : public UMPAS_GroundQueryBackend
+{
+	GENERATED_BODY()
+
+public:
+
+	// Distance between height samples, used to calculate the normal
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Default|GroundQuery", meta=(ClampMin=1))
+	float NormalSampleDistance = 25.f;
+
+	// Whether a physics trace is made when no landscape is under the query
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Default|GroundQuery")
+	bool FallbackToTrace = true;
+
+	virtual bool QueryGround(UWorld* InWorld, const FVector& InStart, const FVector& InEnd, ECollisionChannel InChannel, const FCollisionQueryParams& InQueryParams, FHitResult& OutHit) override;
+
+	virtual void PostInitProperties() override;
+	virtual void BeginDestroy() override;
+
+protected:
+
+	// Landscapes of the world, gathered on the first query and extended when levels are streamed in
+	TArray<TWeakObjectPtr<class ALandscapeProxy>> Landscapes;
+
+	// World, that the landscapes were gathered from
+	TWeakObjectPtr<UWorld> LandscapesWorld;
+
+	// Handle of the level streaming subscription
+	FDelegateHandle LevelAddedHandle;
+
+	// Picks up landscape proxies of levels, streamed into the gathered world (level streaming, World Partition cells)
+	void OnLevelAddedToWorld(class ULevel* InLevel, UWorld* InWorld);
+
+	// Height of the landscape at the given location, false if there is no landscape under it
+	bool GetLandscapeHeight(const FVector& InLocation, float& OutHeight);
+};
+
+
+/**
+ * Projects queries onto the navigation mesh (cheap, but only as precise as the navmesh, normals always face up)
+ */
+UCLASS(meta=(DisplayName="NavMesh Projection"))
+class MPAS_API UMPAS_NavMeshGroundQueryBackend : public UMPAS_GroundQueryBackend
+{
+	GENERATED_BODY()
+
+public:
+
+	// How far horizontally the query can be moved to find the navmesh
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Default|GroundQuery")
+	float ProjectionHorizontalExtent = 25.f;
+
+	// Navmesh is generated slightly above the ground, this offset is subtracted from projected locations
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Default|GroundQuery")
+	float NavMeshHeightOffset = 0.f;
+
+	// Whether a physics trace is made when the query couldn't be projected
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Default|GroundQuery")
+	bool FallbackToTrace = false;
+
+	virtual bool QueryGround(UWorld* InWorld, const FVector& InStart, const FVector& InEnd, ECollisionChannel InChannel, const FCollisionQueryParams& InQueryParams, FHitResult& OutHit) override;
+};
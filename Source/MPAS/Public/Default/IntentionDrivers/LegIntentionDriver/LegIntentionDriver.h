@@ -16,14 +16,25 @@ class MPAS_API UMPAS_LegIntentionDriverState : public UMPAS_IntentionStateBase
 {
 	GENERATED_BODY()
 	
-	// Body segments and legs corresponding to them
-	TMap<class UMPAS_BodySegment*, TArray <class UMPAS_Leg* >> LegsData;
-
-	// Map of leg target location vector layers for each leg
-	TMap<class UMPAS_Leg*, int32> TargetLayers;
-
-	// Map of effector shift vector layers for each leg
-	TMap<class UMPAS_Leg*, int32> EffectorShiftLayers;
+	// Body segments, controlled by this driver, and the range of their legs in the flat leg arrays
+	TArray<class UMPAS_BodySegment*> Bodies;
+	TArray<int32> BodyLegOffsets;
+	TArray<int32> BodyLegCounts;
+
+	// Legs (grouped by body segment) and their layer IDs
+	TArray<class UMPAS_Leg*> Legs;
+	TArray<int32> LegTargetLayers;
+	TArray<int32> LegEffectorShiftLayers;
+
+	// Scratch buffers of a single body update, sized for the body with most legs (reused between updates)
+	TArray<int32> ActiveLegIndices;
+	TArray<TPair<FVector, FVector>> ShiftLimitations;
+	TArray<FVector> Shift;
+
+	// Scratch buffers of the effector shift distribution (reused between updates)
+	TArray<FVector> ShiftLocalLimitMin;
+	TArray<FVector> ShiftLocalLimitMax;
+	TArray<TPair<float, int32>> ShiftBreakpoints;
 
 public:
 
@@ -57,17 +68,11 @@ protected:
 								const TArray<TPair<FVector, FVector>>& InLimitations,
 								const FQuat& LimitSpaceRotation);
 
-	/* 
-	 * Clamps effector shift to it's limitations
-	 * OutClamped contains data, whether each individual offset was clamped
-	 */
-	void ClampShift(TArray<FVector>& InOutShift, TArray<bool>& OutClamped, const TArray<TPair<FVector, FVector>>& InLimitations, const FQuat& LimitSpaceRotation);
-
 	/*
-	 * Redistributes shift from leg's that hit there limitation to the ones that are still capable of moving 
-	 * Updates the values in the InOutShift
+	 * Distributes a single axis of the target shift (in limit space) between the legs: finds the level, that clamped to every leg's limits sums up to InTarget * number of legs
+	 * Writes the result into the InAxis component of InOutLocalShift
 	 */
-	void ShiftRedistributionIteration(TArray<FVector>& InOutShift, const FVector& InTarget, const TArray<bool>& InClamped);
+	void DistributeShiftAxis(TArray<FVector>& InOutLocalShift, int32 InAxis, float InTarget);
 };
 
 
@@ -184,8 +184,14 @@ protected:
 	// Attempts to find ground under the core to determine the elevation of the core
 	FVector CoreGroundTrace(FVector InputCoreLocation)
 	{
+		// Sampling the handler's terrain cache first
+		float CachedHeight;
+		FVector CachedNormal;
+		if (GetHandler()->SampleTerrainCache(InputCoreLocation, CachedHeight, CachedNormal) && FMath::Abs(CachedHeight - InputCoreLocation.Z) <= TraceLength / 2)
+			return FVector(InputCoreLocation.X, InputCoreLocation.Y, CachedHeight) + FVector::UnitZ() * CoreElevation;
+
 		FHitResult Hit;
-		if (GetHandler()->GetWorld()->LineTraceSingleByChannel(Hit, InputCoreLocation + FVector::UnitZ() * TraceLength / 2, InputCoreLocation - FVector::UnitZ() * TraceLength / 2, ECC_Visibility))
+		if (GetHandler()->QueryGround(InputCoreLocation + FVector::UnitZ() * TraceLength / 2, InputCoreLocation - FVector::UnitZ() * TraceLength / 2, Hit, ECC_Visibility))
 			return Hit.Location + FVector::UnitZ() * CoreElevation;
 
 		return InputCoreLocation;
@@ -53,6 +53,15 @@ protected:
 	FVector CachedDesiredLocation;
 	FRotator CachedDesiredRotation;
 
+	// Desired transform on the previous update, used to measure desired velocities
+	FVector PreviousDesiredLocation = FVector::ZeroVector;
+	FQuat PreviousDesiredRotation = FQuat::Identity;
+	bool HasPreviousDesiredTransform = false;
+
+	// Smoothed velocities of the desired transform (angular velocity is axis * radians per second)
+	FVector DesiredVelocity = FVector::ZeroVector;
+	FVector DesiredAngularVelocity = FVector::ZeroVector;
+
 public:
 
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Default|PositionDriving")
@@ -64,6 +73,10 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Default|PositionDriving")
 	float DesiredRotationEnforcement = 1.f;
 
+	// How fast measured desired velocities follow the changes of the desired transform
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Default|PositionDriving")
+	float DesiredVelocitySmoothingSpeed = 10.f;
+
 public:
 	// Returns the location, where the body needs to be placed
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|BodySegment")
@@ -73,6 +86,14 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|BodySegment")
 	const FRotator& GetDesiredRotation() { return CachedDesiredRotation; }
 
+	// Returns the velocity of the desired location (smoothed)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|BodySegment")
+	const FVector& GetDesiredVelocity() { return DesiredVelocity; }
+
+	// Returns the angular velocity of the desired rotation (axis * radians per second, smoothed)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|BodySegment")
+	const FVector& GetDesiredAngularVelocity() { return DesiredAngularVelocity; }
+
 
 
 // BONE TRANSFORM SYNCING
@@ -0,0 +1,163 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MPAS_Limb.h"
+#include "MPAS_BranchingLimb.generated.h"
+
+
+// Defines a single branch (chain of segments) of UMPAS_BranchingLimb
+USTRUCT(BlueprintType)
+struct FMPAS_LimbBranch
+{
+	GENERATED_USTRUCT_BODY()
+
+	// Index of the branch, at the tip of which this branch starts ( -1 - the branch starts at the origin of the limb), must be lower than the index of this branch
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 ParentBranch = -1;
+
+	// How much the target of this branch affects the location of the junction it starts at (only relevant for branches that share a parent)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float Weight = 1.f;
+
+	// Bone, that marks the end of the fetched chain of this branch (the chain is fetched up to the tip bone of the parent branch or up to Fetch_OriginBone)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FName Fetch_TipBone;
+
+	// Segments of the branch from it's base to it's tip (if SetupType is set to FetchFromMesh, bone names and lengths are fetched, other segment data is kept)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FMPAS_LimbSegmentData> Segments;
+};
+
+
+// Branch layout of UMPAS_BranchingLimb, flattened for the solver
+struct FMPAS_BranchingLimbLayout
+{
+	// Index of the first state of each branch in the flat state array (each branch has Segments.Num() + 1 states, the last one is branch's tip)
+	TArray<int32> Offsets;
+
+	// Amount of segments in each branch
+	TArray<int32> SegmentCounts;
+
+	// Parent branch of each branch ( -1 - the branch starts at the origin of the limb)
+	TArray<int32> Parents;
+
+	// Weight of each branch
+	TArray<float> Weights;
+
+	// Whether each branch has an end effector (has no child branches)
+	TArray<bool> IsEndBranch;
+
+	// Segment data, laid out the same way as the flat state array (entries at the tips of the branches are unused)
+	TArray<FMPAS_LimbSegmentData> Segments;
+
+	// Total amount of states
+	int32 StateNum = 0;
+};
+
+
+/**
+ * A limb, that consists of a tree of segment chains with multiple end effectors (e.g. a shared upper arm with two grippers)
+ * All branches are solved jointly with multi-end FABRIK, so the shared segments are positioned with respect to all targets
+ * Solving, caching, interpolation and the IK iteration budget are shared with UMPAS_Limb, Segments are generated from Branches (flat, see FMPAS_BranchingLimbLayout)
+ * TargetType defines targets of the end branches (FirstChildComponent - N-th child element is the target of N-th end branch, TargetVectorStack - each end branch has a stack named "BranchTarget_<BranchIndex>")
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class MPAS_API UMPAS_BranchingLimb : public UMPAS_Limb
+{
+	GENERATED_BODY()
+
+public:
+	UMPAS_BranchingLimb();
+
+// PARAMETERS
+public:
+
+	// Whether swing limits of the segments (SwingTwist angular limit model) should be applied
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|BranchingLimb")
+	bool EnableAngularLimits = false;
+
+	// Branches of the limb, the order of the elements defines the order of the branches (parents must come before their children)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|BranchingLimb")
+	TArray<FMPAS_LimbBranch> Branches;
+
+
+// DATA
+protected:
+
+	// Flattened branch layout
+	FMPAS_BranchingLimbLayout Layout;
+
+	// Child elements of the limb, N-th of them is used as the target of N-th end branch if TargetType is set to FirstChildComponent
+	TArray<USceneComponent*> ChildTargetElements;
+
+	// Target elements of the end branches, used if TargetType is set to FirstChildComponent: < Branch Index : Target >
+	TMap<int32, USceneComponent*> TargetComponents;
+
+	// Target vector stacks of the end branches, used if TargetType is set to TargetVectorStack: < Branch Index : Stack ID >
+	TMap<int32, int32> TargetStackIDs;
+
+	// Distance from the origin of the limb to the tip of each branch along the segments
+	TArray<float> BranchMaxExtents;
+
+
+// INTERFACE
+public:
+
+	// Returns the index of the first state of the branch in the current state array ( -1 if the branch does not exist)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="MPAS|Elements|BranchingLimb")
+	int32 GetBranchStateOffset(int32 InBranch) { return Layout.Offsets.IsValidIndex(InBranch) ? Layout.Offsets[InBranch] : -1; }
+
+	// Returns the ID of the target vector stack of the given end branch, used if TargetType is set to TargetVectorStack ( -1 if the branch has no stack)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="MPAS|Elements|BranchingLimb")
+	int32 GetBranchTargetStackID(int32 InBranch);
+
+	// The point in space (World Space), which the given end branch is trying to reach
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="MPAS|Elements|BranchingLimb")
+	FVector GetBranchTarget(int32 InBranch);
+
+	// Largest distance between the tip of an end branch and it's target after the latest finished solve
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="MPAS|Elements|BranchingLimb")
+	float GetLastSolveError() { return LastSolveError; }
+
+
+// BACKGROUND
+protected:
+
+	// Initializes branches, layout and state
+	virtual void InitLimb() override;
+
+	// Fetches segments of all branches from the skeletal mesh (and their current states), returns false if the mesh is not found
+	bool FetchBranchesFromMesh(TArray<TArray<FMPAS_LimbSegmentState>>& OutBranchStates);
+
+	// Builds the flattened layout, segments and the initial (straight up) state from Branches
+	void BuildLayout();
+
+	// Assigns child elements or target vector stacks to the end branches
+	void AssignBranchTargets();
+
+	// Evaluates origin, up vector and targets of all end branches, each target is evaluated exactly once
+	virtual void GatherSolveInput(FMPAS_LimbSolveInput& OutInput) override;
+
+	// Copies the layout and the targets and wraps multi-end FABRIK into a task
+	virtual FMPAS_LimbSolveTask MakeSolveTask(int32 InMaxIterations, bool InWarmStart) override;
+
+	// Multi-end FABRIK is always iterative
+	virtual bool UsesIterativeSolver() const override { return true; }
+
+public:
+
+	// Multi-end FABRIK: end branches reach for their targets, junctions are placed at the weighted centroid of the bases of their child branches, then all branches are reattached from the origin
+	static TArray<FMPAS_LimbSegmentState> Solve_MultiEndFABRIK_IK(const FVector& InOriginLocation, const TArray<FVector>& InTargets, const FMPAS_BranchingLimbLayout& InLayout, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InApplyAngularLimits, bool& OutConverged, int32& OutIterations, float& OutError);
+
+
+// CALLED BY THE HANDLER
+public:
+
+	// CALLED BY THE HANDLER : Initializing Rig Element
+	virtual void InitRigElement(class UMPAS_Handler* InHandler) override;
+
+	// CALLED BY THE HANDLER : Contains the logic that links this element with other elements in the rig
+	virtual void LinkRigElement(class UMPAS_Handler* InHandler) override;
+};
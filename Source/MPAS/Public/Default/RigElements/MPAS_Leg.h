@@ -37,7 +37,7 @@ protected:
 	// When the leg is ready to make a step, but it has to wait for it's turn
 	bool WaitingOnLegGroup;
 
-	// Wether the leg has moved in current window (the time frame between CurrentLegGroup value changes)
+	// Wether the leg has moved in current window (the time frame between activations of the leg's group)
 	bool HasMovedInCurrentWindow;
 
 	// Leg's target location relative to the the parent element
@@ -46,6 +46,12 @@ protected:
 	// Leg's default location relative to the parent element
 	FVector LegRestingPoseOffset;
 
+	// Leg's default location relative to the parent element, in parent's local space
+	FVector LegRestingPoseOffsetLocal;
+
+	// Index of the leg in the handler's gait scheduler
+	int32 GaitIndex = -1;
+
 	// Effector Shift uses interpolation, THIS is the current value of Effector Shift
 	FVector RealEffectorShift;
 
@@ -58,6 +64,14 @@ protected:
 	// Parent body pointer
 	class UMPAS_BodySegment* ParentBody;
 
+	// Baked step animation curves in the handler ( -1 - the curve is not set, or the legacy timeline is used)
+	int32 StepHeightCurveIndex = -1;
+	int32 StepExtentCurveIndex = -1;
+	int32 StepHeightScalingCurveIndex = -1;
+
+	// Index of the current step in the handler's active steps ( -1 - the leg is not moving, or the legacy timeline is used)
+	int32 ActiveStepIndex = -1;
+
 
 	// Intention Driven Parameter cached values
 	
@@ -77,17 +91,34 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|FootPlacement")
 	float MaxFootVerticalExtent = 200.f;
 
+	// Whether foot traces are batched by the handler and performed asynchronously (results are consumed next frame, the current frame uses a prediction)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|FootPlacement")
+	bool UseAsyncFootTrace = true;
+
+	// Maximal horizontal distance from the latest foot trace result, at which ground location can still be predicted (beyond it a synchronous trace is made)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|FootPlacement", meta=(ClampMin=0))
+	float FootTracePredictionDistance = 100.f;
+
 	// Leg's offset in inactive mode, relative to parent
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|FootPlacement")
 	FVector InactiveOffset = FVector::Zero();
 
 	// Step
+	// Name of the step timeline (only used if UseNativeStepAnimation is disabled)
 	UPROPERTY(BlueprintReadOnly, Category=Background)
 	FName StepTimelineName;
 
+	// Whether steps are animated by the handler together with the steps of other legs (curves are baked into lookup tables), instead of a per-leg timeline
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Step")
+	bool UseNativeStepAnimation = true;
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Step")
 	int32 LegGroup = 0;
 
+	// Offset of the leg's swing window in the gait cycle [0, 1), used if handler's GaitPattern is set to Custom
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Step", meta=(ClampMin=0, ClampMax=1))
+	float GaitPhaseOffset = 0.f;
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Step")
 	float StepLength = 200.f;
 
@@ -119,6 +150,23 @@ public:
 	class UCurveFloat* StepHeightScalingCurve = nullptr;
 
 
+	// Whether leg's target is placed where the parent body is predicted to be when the step lands (fewer, longer steps at speed)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Default|StepPrediction")
+	bool EnableStepPrediction = false;
+
+	// Prediction time as a portion of the step duration (0.5 - the foot lands in the middle of the next stance)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Default|StepPrediction", meta=(ClampMin=0))
+	float StepPrediction_TimeScale = 0.5f;
+
+	// How much the movement input steers the direction of the measured body velocity
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Default|StepPrediction", meta=(ClampMin=0, ClampMax=1))
+	float StepPrediction_InputInfluence = 0.5f;
+
+	// Maximal distance, by which the target can be moved by the prediction
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Default|StepPrediction", meta=(ClampMin=0))
+	float StepPrediction_MaxDistance = 100.f;
+
+
 	// Effector location shift minimal limitation
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Default|ParentPlacement")
 	FVector EffectorShift_Min = FVector(-100, -100, -50);
@@ -144,15 +192,63 @@ protected:
 	// Returns the vertical direction, relative to the host
 	FVector GetUpVector() { return FVector(0.f, 0.f, 1.f); };
 
-	// Returns leg's target location
-	FVector GetTargetLocation();
+	// Leg's target location, calculated during the latest update
+	FVector CachedTargetLocation = FVector::ZeroVector;
+
+	// Leg's basic target location (resting offset, placed by the desired transform of the parent body), calculated during the latest update
+	FVector CachedBasicTargetLocation = FVector::ZeroVector;
+
+	// Returns leg's target location (cached during the latest update)
+	FVector GetTargetLocation() { return CachedTargetLocation; }
+
+	// Calculates leg's target location and caches it for the current update
+	void UpdateTargetLocation();
 
 	// Checks whether the leg should make a step
 	bool ShouldStep();
 
-	// Starts the step animation timeline
+	// Starts the step animation (handler-driven or timeline)
 	void StartStepAnimation();
 
+	// Peak height of the current step, scaled by the step distance
+	float CalculateResultingStepHeight();
+
+
+	// Async foot traces
+
+	// Foot trace slot, used by general foot trace calls (leg target placement)
+	static constexpr int32 FootTraceSlot_Target = 0;
+
+	// Foot trace slot, used by the step animation (the result refines the target of the current step)
+	static constexpr int32 FootTraceSlot_Step = 1;
+
+	// Index of the leg in the handler's foot trace batch ( -1 - the leg is not registered)
+	int32 FootTraceIndex = -1;
+
+	// Whether there is a foot trace result to predict ground location from
+	bool FootTrace_HasResult = false;
+
+	// Whether the latest foot trace has hit anything
+	bool FootTrace_ResultHit = false;
+
+	// Location of the latest foot trace hit (trace start, if nothing was hit)
+	FVector FootTrace_ResultLocation = FVector::ZeroVector;
+
+	// Normal of the latest foot trace hit, together with the location it defines the ground plane used for prediction
+	FVector FootTrace_ResultNormal = FVector::UpVector;
+
+	// Start of the trace, requested for the current step (used to match the asynchronous result with the step)
+	FVector FootTrace_StepTraceStart = FVector::ZeroVector;
+
+	// Finds foot location, using the given foot trace slot: requests an asynchronous trace and returns predicted location, falls back to a synchronous trace if prediction is not possible
+	FVector FootTraceInSlot(const FVector& StepTargetLocation, int32 InSlot);
+
+	// Casts a synchronous foot trace, caching it's result for future predictions, (0, 0, 0) if failed
+	FVector FootTraceSync(const FVector& InStart, const FVector& InEnd);
+
+	// Caches the result of a foot trace for future predictions
+	void CacheFootTraceResult(const FVector& InStart, const FHitResult* InHit);
+
 
 public:
 
@@ -164,6 +260,14 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Elements|Leg")
 	FVector GetLegTargetOffset() { return LegTargetOffset; }
 
+	// Returns leg's basic target location: resting offset, placed by the desired transform of the parent body (calculated once per update)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Elements|Leg")
+	FVector GetBasicTargetLocation() { return CachedBasicTargetLocation; }
+
+	// Returns initial leg's location relative to it's parent element, in parent's local space
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Elements|Leg")
+	FVector GetLegRestingPoseOffsetLocal() { return LegRestingPoseOffsetLocal; }
+
 	// Whether the leg is ready to make a step
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Elements|Leg")
 	bool IsReadyToStep() { return ReadyToStep; }
@@ -180,6 +284,13 @@ public:
 	// Whether this element is currently active=
 	virtual bool GetRigElementActive_Implementation() { return Enabled && ValidPlacement; }
 
+
+	// CALLED BY THE HANDLER : Sets the index of the leg in the handler's foot trace batch
+	void SetFootTraceIndex(int32 InFootTraceIndex) { FootTraceIndex = InFootTraceIndex; }
+
+	// CALLED BY THE HANDLER : Receives the result of an asynchronous foot trace, requested in the given slot (InHit is nullptr if nothing was hit)
+	void OnFootTraceCompleted(int32 InSlot, const FVector& InStart, const FVector& InEnd, const FHitResult* InHit);
+
 	
 
 // BONE TRANSFORM SYNCING
@@ -252,6 +363,9 @@ public:
 	// Updating Rig Element every tick
 	virtual void UpdateRigElement(float DeltaTime) override;
 
+	// CALLED BY THE HANDLER : Called every tick after all rig elements were updated, makes step decisions using the final desired transform of the parent body
+	virtual void PostUpdateRigElement(float DeltaTime) override;
+
 	// CALLED BY THE HANDLER : Synchronizes Rig Element to the most recently fetched bone transforms
 	virtual void SyncToFetchedBoneTransforms(float DeltaTime) override;
 
@@ -260,6 +374,18 @@ public:
 	UFUNCTION()
 	void OnParameterChanged(FName InParameterName);
 
+	// CALLED BY THE GAIT SCHEDULER : The group (or the swing window in PhaseOscillator mode) of this leg has become active
+	void OnLegGroupActivated();
+
+	// CALLED BY THE HANDLER : Moves the foot to the given location of the step animation
+	void SetStepAnimationLocation(const FVector& InLocation);
+
+	// CALLED BY THE HANDLER : The step animation has finished
+	void OnStepAnimationFinished();
+
+	// CALLED BY THE HANDLER : Sets the index of the current step in the handler's active steps
+	void SetActiveStepIndex(int32 InActiveStepIndex) { ActiveStepIndex = InActiveStepIndex; }
+
 	// CALLED BY THE HANDLER : NOTIFICATION Called when a subscribed-to timeline is updated
 	UFUNCTION()
 	void OnStepAnimationTimelineUpdated(FName InTimelineName, float CurrentTime);
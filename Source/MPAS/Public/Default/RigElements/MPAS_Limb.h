@@ -4,9 +4,21 @@
 
 #include "CoreMinimal.h"
 #include "MPAS_VoidRigElement.h"
+#include "WorldCollision.h"
 #include "MPAS_Limb.generated.h"
 
 
+// How angular limits of a limb segment are defined
+UENUM(BlueprintType)
+enum class EMPAS_LimbAngularLimitModel : uint8
+{
+	// Per-axis limits of the relative rotation (AngularLimits_Min / AngularLimits_Max)
+	EulerAngles UMETA(DisplayName="Euler Angles"),
+
+	// Cone limit of segment's direction around parent's direction (SwingLimit) + limit of the rotation around segment's own axis (TwistLimit_Min / TwistLimit_Max)
+	SwingTwist UMETA(DisplayName="Swing Twist")
+};
+
 // Defines a single segment in UMPAS_Limb
 USTRUCT(BlueprintType)
 struct FMPAS_LimbSegmentData
@@ -17,6 +29,10 @@ struct FMPAS_LimbSegmentData
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	float Length;
 
+	// Which limits are used by the limited algorithms
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	EMPAS_LimbAngularLimitModel AngularLimitModel;
+
 	// Rotational limits for each rotation axis
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FRotator AngularLimits_Min;
@@ -25,6 +41,18 @@ struct FMPAS_LimbSegmentData
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FRotator AngularLimits_Max;
 
+	// Max angle (in degrees) between the direction of this segment and the direction of the previous segment
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float SwingLimit;
+
+	// Min rotation (in degrees) around segment's own axis, relative to the previous segment
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float TwistLimit_Min;
+
+	// Max rotation (in degrees) around segment's own axis, relative to the previous segment
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float TwistLimit_Max;
+
 	// Name of the bone, corresponding to this limb segment
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FName BoneName;
@@ -33,7 +61,26 @@ struct FMPAS_LimbSegmentData
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FVector2D SegmentMeshExtent;
 
-	FMPAS_LimbSegmentData(): Length(0), AngularLimits_Min(FRotator(-360, -360, -360)), AngularLimits_Max(FRotator(360, 360, 360)), BoneName(FName()), SegmentMeshExtent(FVector2D(1, 1)) {}
+
+	// Cached sines and cosines of swing-twist limits (and their halves, for quaternion components), so the solvers don't have to use any trigonometry
+	float SwingLimit_Cos, SwingLimit_Sin;
+	float SwingLimit_HalfCos, SwingLimit_HalfSin;
+	float TwistLimit_HalfMinCos, TwistLimit_HalfMinSin;
+	float TwistLimit_HalfMaxCos, TwistLimit_HalfMaxSin;
+
+	// Recalculates cached swing-twist values, must be called after the limits are changed
+	void CacheSwingTwistLimits()
+	{
+		FMath::SinCos(&SwingLimit_Sin, &SwingLimit_Cos, FMath::DegreesToRadians(FMath::Clamp(SwingLimit, 0.f, 180.f)));
+		FMath::SinCos(&SwingLimit_HalfSin, &SwingLimit_HalfCos, FMath::DegreesToRadians(FMath::Clamp(SwingLimit, 0.f, 180.f) * 0.5f));
+		FMath::SinCos(&TwistLimit_HalfMinSin, &TwistLimit_HalfMinCos, FMath::DegreesToRadians(FMath::Clamp(TwistLimit_Min, -180.f, 180.f) * 0.5f));
+		FMath::SinCos(&TwistLimit_HalfMaxSin, &TwistLimit_HalfMaxCos, FMath::DegreesToRadians(FMath::Clamp(TwistLimit_Max, -180.f, 180.f) * 0.5f));
+	}
+
+	FMPAS_LimbSegmentData(): Length(0), AngularLimitModel(EMPAS_LimbAngularLimitModel::EulerAngles), AngularLimits_Min(FRotator(-360, -360, -360)), AngularLimits_Max(FRotator(360, 360, 360)), SwingLimit(180), TwistLimit_Min(-180), TwistLimit_Max(180), BoneName(FName()), SegmentMeshExtent(FVector2D(1, 1)) 
+	{
+		CacheSwingTwistLimits();
+	}
 };
 
 /*
@@ -45,6 +92,10 @@ struct FMPAS_AdditionalLimbSegmentData
 {
 	GENERATED_USTRUCT_BODY()
 
+	// Which limits are used by the limited algorithms
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	EMPAS_LimbAngularLimitModel AngularLimitModel;
+
 	// Rotational limits for each rotation axis
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FRotator AngularLimits_Min;
@@ -53,11 +104,23 @@ struct FMPAS_AdditionalLimbSegmentData
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FRotator AngularLimits_Max;
 
+	// Max angle (in degrees) between the direction of this segment and the direction of the previous segment
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float SwingLimit;
+
+	// Min rotation (in degrees) around segment's own axis, relative to the previous segment
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float TwistLimit_Min;
+
+	// Max rotation (in degrees) around segment's own axis, relative to the previous segment
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float TwistLimit_Max;
+
 	// NON-Length plane extent of the mesh of this segment (used for visualization)
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FVector2D SegmentMeshExtent;
 
-	FMPAS_AdditionalLimbSegmentData(): AngularLimits_Min(FRotator(-360, -360, -360)), AngularLimits_Max(FRotator(360, 360, 360)), SegmentMeshExtent(FVector2D(1, 1)) {}
+	FMPAS_AdditionalLimbSegmentData(): AngularLimitModel(EMPAS_LimbAngularLimitModel::EulerAngles), AngularLimits_Min(FRotator(-360, -360, -360)), AngularLimits_Max(FRotator(360, 360, 360)), SwingLimit(180), TwistLimit_Min(-180), TwistLimit_Max(180), SegmentMeshExtent(FVector2D(1, 1)) {}
 };
 
 
@@ -140,10 +203,40 @@ enum class EMPAS_LimbSolvingAlgorithm : uint8
 	PistonMulti UMETA(DisplayName = "Piston Multi"),
 
 	// Turns the limb into a telescopic multi-stage piston for mechanical effects, segments extend one by one
-	PistonSequential UMETA(DisplayName = "Piston Sequential")
+	PistonSequential UMETA(DisplayName = "Piston Sequential"),
 
-	//// Gauss-Seidel IK approximation method (paper link: https://arxiv.org/pdf/2211.00330)
-	//Gauss_Seidel UMETA(DisplayName="Gauss-Seidel")
+	// Implements CCD IK algorithm with angular limits
+	CCD_Limited_IK UMETA(DisplayName = "CCD Limited IK"),
+
+	// Gauss-Seidel IK approximation method (paper link: https://arxiv.org/pdf/2211.00330)
+	// Supports pole targets, usually converges in less iterations than PoleFABRIK on long chains
+	Gauss_Seidel UMETA(DisplayName="Gauss-Seidel"),
+
+	// Gauss-Seidel IK approximation method with angular limits
+	Gauss_Seidel_Limited UMETA(DisplayName="Gauss-Seidel Limited")
+};
+
+// How segment roll is recalculated after solving
+UENUM(BlueprintType)
+enum class EMPAS_LimbRollRecalculationMode : uint8
+{
+	// Each segment is rolled separately, so that it's up vector faces away from the limb origin in the plane of the segment
+	SolutionPlane UMETA(DisplayName="Solution Plane"),
+
+	// The first segment faces the pole target, the rest of the segments get their frame by minimally rotating the previous one (parallel transport)
+	// Cheaper and does not flip, as each segment's roll only depends on the change of direction along the chain
+	ParallelTransport UMETA(DisplayName="Parallel Transport")
+};
+
+// How the current state of the limb transitions to a newly solved state
+UENUM(BlueprintType)
+enum class EMPAS_LimbInterpolationMode : uint8
+{
+	// Segment rotations move towards the target at a constant speed (LimbInterpolationSpeed), interpolated as Euler angles
+	ConstantRotator UMETA(DisplayName="Constant Rotator"),
+
+	// Segment rotations follow the target with a critically damped spring (SpringHalfLife), interpolated as quaternions
+	QuaternionSpring UMETA(DisplayName="Quaternion Spring")
 };
 
 // What should be used as a target of the limb
@@ -169,6 +262,129 @@ enum class EMPAS_LimbSetupType : uint8
 };
 
 
+// All world space inputs of a single limb solve, gathered once per update
+struct FMPAS_LimbSolveInput
+{
+	// Location of the limb's origin
+	FVector OriginLocation = FVector::ZeroVector;
+
+	// The point the limb is trying to reach
+	FVector TargetLocation = FVector::ZeroVector;
+
+	// Up vector of the limb component
+	FVector UpVector = FVector::UpVector;
+
+	// Pole target location for every segment
+	TArray<FVector> PoleTargets;
+
+	// Target of every branch, used by branching limbs (see UMPAS_BranchingLimb)
+	TArray<FVector> BranchTargets;
+
+	// Whether all inputs are within the tollerance from the other's inputs
+	bool Equals(const FMPAS_LimbSolveInput& InOther, float InTollerance) const
+	{
+		if (!OriginLocation.Equals(InOther.OriginLocation, InTollerance) || !TargetLocation.Equals(InOther.TargetLocation, InTollerance) || !UpVector.Equals(InOther.UpVector, InTollerance))
+			return false;
+
+		if (PoleTargets.Num() != InOther.PoleTargets.Num() || BranchTargets.Num() != InOther.BranchTargets.Num())
+			return false;
+
+		for (int32 i = 0; i < PoleTargets.Num(); i++)
+			if (!PoleTargets[i].Equals(InOther.PoleTargets[i], InTollerance))
+				return false;
+
+		for (int32 i = 0; i < BranchTargets.Num(); i++)
+			if (!BranchTargets[i].Equals(InOther.BranchTargets[i], InTollerance))
+				return false;
+
+		return true;
+	}
+};
+
+// Solve, prepared on the game thread and run on a background thread (or on the game thread if EnableAsyncCalculation is false), returns the solved state
+typedef TFunction<TArray<FMPAS_LimbSegmentState>(bool& OutConverged, int32& OutIterations, float& OutError)> FMPAS_LimbSolveTask;
+
+// Bone chain data of a skeletal mesh, extracted once and shared between all limbs, that fetch the same chain from the same mesh
+struct FMPAS_LimbFetchedChain
+{
+	// Chain bone indices, from the origin bone to the tip bone
+	TArray<int32> BoneIndices;
+
+	// Chain bone names, from the origin bone to the tip bone
+	TArray<FName> BoneNames;
+
+	// Reference pose offset from each bone to the next one in component space (one entry less than there are bones)
+	TArray<FVector> SegmentOffsets;
+
+	// Reference pose locations of the bones in component space
+	TArray<FVector> RestLocations;
+
+	// Reference pose rotations of the bones in component space
+	TArray<FQuat> RestRotations;
+
+	// Reference pose transforms of the bones relative to their parents (entries of the reference skeleton's bone pose)
+	TArray<FTransform> LocalRestTransforms;
+};
+
+// Coarse grid in limb's local space (relative to the limb's origin), storing a solved pose and reachability of the center of every cell
+struct FMPAS_LimbWarmStartLookup
+{
+	// Amount of cells along each axis
+	int32 Resolution = 0;
+
+	// Half of the size of the grid along each axis (the grid covers limb's max extent)
+	float Extent = 0.f;
+
+	// Size of a single cell
+	float CellSize = 0.f;
+
+	// Amount of segments in every stored pose
+	int32 SegmentNum = 0;
+
+	// Whether the center of each cell can be reached by the limb
+	TArray<bool> Reachable;
+
+	// Solved segment directions of each cell (SegmentNum directions per cell, from the first segment to the last one)
+	TArray<FVector> Directions;
+
+	// Whether the lookup has been built
+	bool IsValid() const { return Resolution > 0 && Reachable.Num() == Resolution * Resolution * Resolution; }
+
+	// Returns the index of the cell, containing the given location (relative to the limb's origin), -1 if the location is outside of the grid
+	int32 GetCellIndex(const FVector& InLocalLocation) const
+	{
+		if (!IsValid())
+			return -1;
+
+		const FVector L_Cell = (InLocalLocation + FVector(Extent)) / CellSize;
+		const int32 X = FMath::FloorToInt(L_Cell.X);
+		const int32 Y = FMath::FloorToInt(L_Cell.Y);
+		const int32 Z = FMath::FloorToInt(L_Cell.Z);
+
+		if (X < 0 || Y < 0 || Z < 0 || X >= Resolution || Y >= Resolution || Z >= Resolution)
+			return -1;
+
+		return X + (Y + Z * Resolution) * Resolution;
+	}
+
+	// Returns the center of the given cell (relative to the limb's origin)
+	FVector GetCellCenter(int32 InX, int32 InY, int32 InZ) const
+	{
+		return FVector(InX + 0.5f, InY + 0.5f, InZ + 0.5f) * CellSize - FVector(Extent);
+	}
+};
+
+// Solver kernels, specialized for a fixed segment count, selected once during limb initialization (nullptr means that the generic solver is used)
+struct FMPAS_LimbSolverKernels
+{
+	// FABRIK IK kernel
+	TArray<FMPAS_LimbSegmentState> (*FABRIK_IK)(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations) = nullptr;
+
+	// PoleFABRIK IK kernel
+	TArray<FMPAS_LimbSegmentState> (*PoleFABRIK_IK)(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations) = nullptr;
+};
+
+
 // LIMB
 
 /**
@@ -178,6 +394,9 @@ UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class MPAS_API UMPAS_Limb : public UMPAS_VoidRigElement
 {
 	GENERATED_BODY()
+
+	// Solver benchmark calls solvers directly
+	friend class UMPAS_LimbBenchmarkLibrary;
 	
 public:
 	UMPAS_Limb();
@@ -201,6 +420,18 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Interpolation")
 	float LimbInterpolationSpeed = 0.f;
 
+	// How the current state of the limb transitions to a newly solved state
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Interpolation")
+	EMPAS_LimbInterpolationMode InterpolationMode = EMPAS_LimbInterpolationMode::ConstantRotator;
+
+	// Time (in seconds) it takes the spring to cover half of the remaining distance to the target state ( 0 - means instant transition), used in QuaternionSpring mode
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Interpolation")
+	float SpringHalfLife = 0.05f;
+
+	// Minimal time (in seconds) between two solves ( 0 - means the limb is solved every update), interpolation keeps the limb smooth in between
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Interpolation")
+	float SolveInterval = 0.f;
+
 	// Should inverse kinematics algorithms run on a background thread or on the main thread?
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb")
 	bool EnableAsyncCalculation = true;
@@ -214,6 +445,10 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Rotation")
 	bool EnableRollRecalculation = true;
 
+	// How segment roll is recalculated after solving (works only if EnableRollRecalculation is set to True)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Rotation")
+	EMPAS_LimbRollRecalculationMode RollRecalculationMode = EMPAS_LimbRollRecalculationMode::SolutionPlane;
+
 	// Used to fix Limb rotation (play around with it) (works only if EnableRollRecalculation is set to True) - Additional roll that is added during segment roll recalculation
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Rotation")
 	float LimbRoll = 0.f;
@@ -226,6 +461,61 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|InverseKinematics")
 	float IK_ErrorTollerance = 10.f;
 
+	// If true, solvers will be seeded with the previous solution instead of being reinitialized (PoleFABRIK algorithms are reinitialized from pole targets otherwise)
+	// Already converged solutions terminate before the first iteration
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|InverseKinematics")
+	bool IK_EnableWarmStart = false;
+
+	// How important this limb is, when the handler distributes it's IK iteration budget between limbs (see UMPAS_Handler::IK_IterationBudget)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|InverseKinematics")
+	float IK_Significance = 1.f;
+
+	// If true, the limb will skip solving entirely when its origin, target and pole targets have not changed since the last converged solution
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|SolveCaching")
+	bool EnableSolveCaching = true;
+
+	// Maximum per-axis difference between current and last solved inputs, for them to be considered unchanged
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|SolveCaching")
+	float SolveCache_Tollerance = 0.01f;
+
+	// If true, a coarse grid of solved poses is precomputed (on a background thread) during limb initialization
+	// It is used to seed iterative solvers after big target jumps and to answer IsTargetReachable queries
+	// PoleFABRIK and Gauss-Seidel algorithms are always seeded from their pole targets, so for them the lookup only answers IsTargetReachable queries
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|WarmStartLookup")
+	bool EnableWarmStartLookup = false;
+
+	// Amount of cells of the lookup grid along each axis (memory and build time grow cubically)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|WarmStartLookup", meta=(ClampMin=2, ClampMax=32))
+	int32 WarmStartLookup_Resolution = 8;
+
+	// Minimal distance the target has to move (relative to the origin) since the last solve for the solver to be seeded from the lookup
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|WarmStartLookup")
+	float WarmStartLookup_JumpDistance = 50.f;
+
+	// If true, segments are pushed out of the environment after solving, using a few asynchronous sphere sweeps along the segments per update
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Clearance")
+	bool EnableClearanceConstraint = false;
+
+	// Radius of the segment capsules, that have to stay clear of the environment
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Clearance")
+	float Clearance_Radius = 10.f;
+
+	// Collision channel, used by the clearance sweeps
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Clearance")
+	TEnumAsByte<ECollisionChannel> Clearance_Channel = ECC_WorldStatic;
+
+	// How many segments are tested per update (segments are tested in a round-robin order, each result is used until the segment is tested again)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Clearance", meta=(ClampMin=1))
+	int32 Clearance_QueriesPerUpdate = 2;
+
+	// How much of the segment's correction is kept, when it's sweep doesn't hit anything (prevents segments from oscillating in and out of the environment)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Clearance", meta=(ClampMin=0, ClampMax=1))
+	float Clearance_CorrectionDecay = 0.5f;
+
+	// If true, all components of the owner are ignored by the clearance sweeps (no self-collision), the fetch mesh is always ignored
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|Clearance")
+	bool Clearance_IgnoreOwner = false;
+
 	// Bone, that marks the beginning of the fetched chain
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Limb|FetchFromMesh")
 	FName Fetch_OriginBone;
@@ -269,6 +559,9 @@ protected:
 	// Segment configuration the limb has to assume, by interpolating to it from the current state
 	TArray<FMPAS_LimbSegmentState> TargetState;
 
+	// Index of the state, whose segment ends at each state ( -1 - the origin of the limb), empty means that the states form a single chain
+	TArray<int32> StateParents;
+
 	// Whether the limb is in a process of asynchronoulsy solving it's state;
 	bool CurrentlySolving;
 
@@ -281,6 +574,93 @@ protected:
 	// Total lenght of all limb segments
 	float MaxExtent;
 
+	// Solver kernels, specialized for the current segment count
+	FMPAS_LimbSolverKernels SolverKernels;
+
+	// Time since the limb has last attempted solving
+	float TimeSinceLastSolve = 0.f;
+
+
+	// Spring interpolation (arrays are indexed by segment)
+
+	// Rotations of the target state as quaternions, updated when a solve is finished
+	TArray<FQuat> TargetRotations;
+
+	// Current spring rotations
+	TArray<FQuat> SpringRotations;
+
+	// Current spring angular velocities (scaled axis, radians per second)
+	TArray<FVector> SpringAngularVelocities;
+
+
+	// Solve caching
+
+	// Whether the last solved inputs are associated with a finished solution
+	bool HasCachedSolution;
+
+	// Whether the latest finished solution has reached the target within IK_ErrorTollerance
+	bool LastSolveConverged;
+
+	// Inputs of the latest dispatched solve
+	EMPAS_LimbSolvingAlgorithm LastSolvedAlgorithm;
+	FMPAS_LimbSolveInput LastSolveInput;
+
+	// Roll settings of the latest dispatched solve (applied by the solve, so they are a part of the cached inputs)
+	bool LastSolveEnableRollRecalculation;
+	EMPAS_LimbRollRecalculationMode LastSolveRollRecalculationMode;
+	float LastSolveLimbRoll;
+
+	// Inputs of the current update (kept between updates to avoid reallocation)
+	FMPAS_LimbSolveInput SolveInput;
+
+
+	// Iteration budget
+
+	// Amount of IK iterations the handler has granted this limb for the current update (negative value means unlimited)
+	int32 GrantedIterations = -1;
+
+	// Amount of iterations the latest finished solve has used
+	int32 LastSolveIterations;
+
+	// Distance between the tip and the target after the latest finished solve
+	float LastSolveError;
+
+	// Whether the latest dispatched solve had less iterations than IK_MaxIterations because of the budget
+	bool LastSolveBudgetLimited;
+
+	// Amount of updates since the limb has last solved (or confirmed it's cached solution)
+	int32 FramesSinceLastSolve;
+
+	// Whether the inputs, gathered during the rig update, require a solve (dispatched by the handler after the budget is distributed)
+	bool SolvePending = false;
+
+
+	// Warm-start lookup
+
+	// Precomputed poses and reachability, empty until built
+	FMPAS_LimbWarmStartLookup WarmStartLookup;
+
+	// Incremented on every rebuild, so results of outdated builds are discarded
+	int32 WarmStartLookupVersion = 0;
+
+
+	// Clearance
+
+	// Offset, that pushes each segment out of the environment (World Space)
+	TArray<FVector> ClearanceCorrections;
+
+	// Latest solution before the clearance corrections were applied (sweeps test it, so corrections don't hide the penetration they are fixing)
+	TArray<FMPAS_LimbSegmentState> UncorrectedTargetState;
+
+	// Whether corrections have changed since they were last applied, so the cached solution has to be corrected again
+	bool ClearanceDirty = false;
+
+	// Next segment to be tested
+	int32 ClearanceCursor = 0;
+
+	// Delegate, receiving results of the clearance sweeps
+	FTraceDelegate ClearanceTraceDelegate;
+
 
 
 // INTERFACE
@@ -310,6 +690,34 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "MPAS|Elements|Limb")
 	void OverrideAttachmentParent(UMPAS_RigElement* NewParent);
 
+	// Forces the limb to solve on the next update, even if its inputs have not changed (call after modifying Segments or solver settings at runtime)
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Elements|Limb")
+	void InvalidateSolveCache();
+
+	// Whether the given point (World Space) can be reached by the limb (uses the warm-start lookup if it is built, otherwise only checks limb's max extent)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Elements|Limb")
+	bool IsTargetReachable(FVector InTarget);
+
+	// Rebuilds the warm-start lookup on a background thread (call after modifying Segments at runtime, if EnableWarmStartLookup is set to True)
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Elements|Limb")
+	void RebuildWarmStartLookup();
+
+
+	// CALLED BY THE HANDLER : Whether the limb is going to compete for the handler's IK iteration budget
+	bool RequiresIterationBudget();
+
+	// CALLED BY THE HANDLER : Solves the limb, if PrepareSolve has marked it during the rig update (after the handler has distributed the iteration budget)
+	void DispatchPendingSolve();
+
+	// CALLED BY THE HANDLER : Priority of the limb in the IK iteration budget distribution (significance, error magnitude, visibility and starvation time)
+	float GetIterationBudgetPriority() const;
+
+	// CALLED BY THE HANDLER : How many iterations the limb is expected to need on this update
+	int32 GetEstimatedIterationNeed() const;
+
+	// CALLED BY THE HANDLER : Sets the amount of IK iterations the limb is allowed to use on this update (negative value means unlimited)
+	void SetGrantedIterations(int32 InIterations) { GrantedIterations = InIterations; }
+
 
 	// Returns the mesh, from which the bone chain will be fetched, !IF SetupType is set to FetchFromMesh!
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category="MPAS|Elements|Limb")
@@ -324,13 +732,28 @@ public:
 protected:
 
 	// Initializes limb's segments and state
-	void InitLimb();
+	virtual void InitLimb();
 
-	// Solves the limb by applying the specified algorithm to the segments
+	// Gathers solve inputs during the rig update, the limb is marked for dispatch if they don't match the cached solution
+	void PrepareSolve();
+
+	// Solves the limb by applying the specified algorithm to the segments (inputs are gathered by PrepareSolve)
 	void SolveLimb();
 
+	// Copies the data the solve needs and wraps the solver into a task (called by SolveLimb, before the solve inputs are remembered)
+	virtual FMPAS_LimbSolveTask MakeSolveTask(int32 InMaxIterations, bool InWarmStart);
+
+	// Whether the limb is solved by an iterative solver (only those limbs compete for the handler's IK iteration budget)
+	virtual bool UsesIterativeSolver() const { return IsIterativeAlgorithm(Algoritm); }
+
 	// A call back from the background thread, that indicates that the limb has finished solving it's state
-	void FinishSolving(TArray<FMPAS_LimbSegmentState> ResultingState);
+	void FinishSolving(TArray<FMPAS_LimbSegmentState> ResultingState, bool InConverged, int32 InIterations, float InError);
+
+	// Whether the given solve inputs match the inputs of the last converged solution (within SolveCache_Tollerance)
+	bool IsSolveCached(EMPAS_LimbSolvingAlgorithm InAlgorithm, const FMPAS_LimbSolveInput& InInput) const;
+
+	// Evaluates origin, target, up vector and all pole targets of the limb, target stack is evaluated exactly once
+	virtual void GatherSolveInput(FMPAS_LimbSolveInput& OutInput);
 
 	// Updates the current state of the specified segment
 	void WriteSegmentState(int32 InSegment, const FMPAS_LimbSegmentState& InState);
@@ -338,30 +761,87 @@ protected:
 	// Handles interpolation of the current state to the target state
 	void InterpolateLimb(float DeltaTime);
 
+	// Moves current segment rotations towards the target state with a critically damped spring, rebuilding segment locations
+	void InterpolateLimb_Spring(float DeltaTime);
+
+	// Starts asynchronous clearance sweeps for the next Clearance_QueriesPerUpdate segments of the target state
+	void DispatchClearanceQueries();
+
+	// Receives the result of a clearance sweep (the segment index is passed as user data)
+	void OnClearanceSweepCompleted(const FTraceHandle& InTraceHandle, FTraceDatum& InTraceDatum);
+
 	// Calculates resulting location of the pole target in world space
 	FVector CalculatePoleTargetLocation(const FMPAS_LimbPoleTarget& InPoleTargetSettings);
 
+	// Calculates resulting location of the pole target in world space, using already evaluated limb origin, target and up vector
+	FVector CalculatePoleTargetLocation(const FMPAS_LimbPoleTarget& InPoleTargetSettings, const FVector& InOriginLocation, const FVector& InTargetLocation, const FVector& InUpVector);
+
 	
 	// Algorithms
 	// 'static' because they are going to run in a background thread
 
+	// Selects and runs the requested algorithm, recalculates segment roll if needed
+	// OutConverged is set if the result has reached the target, OutIterations and OutError report the amount of iterations used and the remaining tip error
+	static TArray<FMPAS_LimbSegmentState> ExecuteSolvingAlgorithm(EMPAS_LimbSolvingAlgorithm InAlgorithm, const FMPAS_LimbSolveInput& InInput, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, float InLimbMaxExtent, bool InWarmStart, bool InEnableRollRecalculation, float InLimbRoll, EMPAS_LimbRollRecalculationMode InRollRecalculationMode, const FMPAS_LimbSolverKernels& InKernels, bool& OutConverged, int32& OutIterations, float& OutError);
+
+	// Whether the algorithm iteratively approaches the target (the rest of the algorithms are solved in a single pass)
+	static bool IsIterativeAlgorithm(EMPAS_LimbSolvingAlgorithm InAlgorithm);
+
+	// Selects solver kernels, specialized for the given segment count (2, 3, 4 and 6 segments are supported)
+	static FMPAS_LimbSolverKernels SelectSolverKernels(int32 InSegmentCount);
+
+	// Returns bone chain data between the given bones of the mesh, extracted once per mesh and bone pair and shared by all limbs (nullptr if the chain can't be fetched)
+	static TSharedPtr<const FMPAS_LimbFetchedChain> GetFetchedChain(USkeletalMesh* InMesh, FName InOriginBone, FName InTipBone);
+
+	// Whether the cached chain still matches the given reference skeleton (bone indices, names and local reference pose of the chain bones, editor builds also check the component space pose)
+	static bool IsFetchedChainValid(const FMPAS_LimbFetchedChain& InChain, const struct FReferenceSkeleton& InRefSkeleton);
+
+	// Whether the algorithm applies angular limits of the segments
+	static bool IsLimitedAlgorithm(EMPAS_LimbSolvingAlgorithm InAlgorithm);
+
+	// Whether the algorithm seeds cold starts from the pole targets (its bend plane comes from that seeding)
+	static bool IsPoleSeededAlgorithm(EMPAS_LimbSolvingAlgorithm InAlgorithm);
+
+	// Solves the limb for the center of every cell of a grid around the origin, each cell is seeded with the pose of the previous one
+	static FMPAS_LimbWarmStartLookup BuildWarmStartLookup(const TArray<FMPAS_LimbSegmentData>& InSegments, float InLimbMaxExtent, int32 InResolution, bool InApplyAngularLimits, int32 InMaxIterations, float InTollerance);
+
+	// Overwrites the state with the pose, stored in the given cell of the lookup
+	static void ApplyWarmStartPose(const FMPAS_LimbWarmStartLookup& InLookup, int32 InCellIndex, const FVector& InOriginLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, TArray<FMPAS_LimbSegmentState>& InOutState);
+
+	// Moves inner joints by the corrections of their adjacent segments, then restores segment lengths with a single FABRIK iteration towards the solved tip
+	static void ApplyClearanceCorrections(TArray<FMPAS_LimbSegmentState>& InOutState, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FVector>& InCorrections);
+
+	// FABRIK IK, specialized for a fixed segment count, works on stack-allocated arrays and only converts directions to rotations after the last iteration
+	template<int32 N>
+	static TArray<FMPAS_LimbSegmentState> Solve_FABRIK_IK_Fixed(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations);
+
+	// PoleFABRIK IK, specialized for a fixed segment count, works on stack-allocated arrays and only converts directions to rotations after the last iteration
+	template<int32 N>
+	static TArray<FMPAS_LimbSegmentState> Solve_PoleFABRIK_IK_Fixed(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations);
+
 	// Rotate To Target
 	static TArray<FMPAS_LimbSegmentState> Solve_RotateToTarget(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState);
 
 	// FABRIK IK
-	static TArray<FMPAS_LimbSegmentState> Solve_FABRIK_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance);
+	static TArray<FMPAS_LimbSegmentState> Solve_FABRIK_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations = nullptr);
 	
 	// FABRIK Limited
-	static TArray<FMPAS_LimbSegmentState> Solve_FABRIK_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance);
+	static TArray<FMPAS_LimbSegmentState> Solve_FABRIK_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations = nullptr);
 
 	// CCD IK
-	static TArray<FMPAS_LimbSegmentState> Solve_CCD_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance);
+	static TArray<FMPAS_LimbSegmentState> Solve_CCD_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations = nullptr);
+
+	// CCD Limited
+	static TArray<FMPAS_LimbSegmentState> Solve_CCD_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, int32* OutIterations = nullptr);
+
+	// Shared CCD implementation, each iteration is linear in segment count (only the tip is moved during the sweep, the chain is rebuilt once afterwards)
+	static TArray<FMPAS_LimbSegmentState> SolveCCD(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, int32 InMaxIterations, float InTollerance, bool InApplyAngularLimits, int32* OutIterations = nullptr);
 
 	// PoleFABRIK IK - custom version of FABRIK IK, sligtly slower, but implements support for pole targets, making it the most usable algorithm out of the ones presented here
-	static TArray<FMPAS_LimbSegmentState> Solve_PoleFABRIK_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector);
+	static TArray<FMPAS_LimbSegmentState> Solve_PoleFABRIK_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations = nullptr);
 
 	// PoleFABRIK Limited - custom version of FABRIK IK, sligtly slower, but implements support for pole targets, making it the most usable algorithm out of the ones presented here
-	static TArray<FMPAS_LimbSegmentState> Solve_PoleFABRIK_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector);
+	static TArray<FMPAS_LimbSegmentState> Solve_PoleFABRIK_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations = nullptr);
 
 	// Turns the limb into a telescopic multi-stage piston for mechanical effects, all segments extend at the same time
 	static TArray<FMPAS_LimbSegmentState> Solve_Piston_Multi(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, float InLimbMaxExtent);
@@ -369,13 +849,22 @@ protected:
 	// Turns the limb into a telescopic multi-stage piston for mechanical effects, segments extend one by one
 	static TArray<FMPAS_LimbSegmentState> Solve_Piston_Sequential(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState);
 
-	//// Gauss-Seidel IK (parer link: https://arxiv.org/pdf/2211.00330)
-	//static TArray<FMPAS_LimbSegmentState> Solve_Gauss_Seidel_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector);
+	// Gauss-Seidel IK (parer link: https://arxiv.org/pdf/2211.00330)
+	static TArray<FMPAS_LimbSegmentState> Solve_Gauss_Seidel_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations = nullptr);
+
+	// Gauss-Seidel Limited
+	static TArray<FMPAS_LimbSegmentState> Solve_Gauss_Seidel_Limited_IK(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, const FVector& InUpVector, bool InWarmStart, int32* OutIterations = nullptr);
+
+	// Shared Gauss-Seidel implementation
+	static TArray<FMPAS_LimbSegmentState> SolveGaussSeidel(const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FMPAS_LimbSegmentState>& InCurrentState, const TArray<FVector>& InPoleTargets, int32 InMaxIterations, float InTollerance, bool InWarmStart, bool InApplyAngularLimits, int32* OutIterations = nullptr);
 
 
 	// Recalculating segment roll rotation
 	static void RecalculateRoll(TArray<FMPAS_LimbSegmentState>& InOutState, float InLimbRoll, const FVector& InOriginLocation, const FVector& InTargetLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FVector>& InPoleTargets, const FVector& InUpVector);
 
+	// Recalculating segment roll rotation using parallel-transported frames
+	static void RecalculateRoll_ParallelTransport(TArray<FMPAS_LimbSegmentState>& InOutState, float InLimbRoll, const FVector& InOriginLocation, const TArray<FMPAS_LimbSegmentData>& InSegments, const TArray<FVector>& InPoleTargets, const FVector& InUpVector);
+
 	// CALLED BY THE HANDLER
 	// Initializing Rig Element
 	virtual void InitRigElement(class UMPAS_Handler* InHandler) override;
@@ -399,6 +888,15 @@ protected:
 	// Projects location vector on to a "solution plane" (plane constructed from 3 points: Limb Origin, Limb Target and Pole Target)
 	static FVector ProjectLocationOnToSolutionPlane(const FVector& InLocation, const FVector& InLimbOrigin, const FVector& InLimbTarget, const FVector& InPoleTarget);
 
+	// Clamps segment's rotation relative to it's parent segment with segment's angular limits
+	static FQuat ClampRelativeSegmentRotation(const FQuat& InRotation, const FQuat& InParentRotation, const FMPAS_LimbSegmentData& InSegment);
+
+	// Clamps segment's rotation (relative to it's parent segment's rotation) with swing-twist limits, twist axis is segment's forward axis
+	static FQuat ClampSwingTwist(const FQuat& InRelativeRotation, const FMPAS_LimbSegmentData& InSegment);
+
+	// Clamps segment's direction to the swing cone around parent's direction (both directions must be normalized)
+	static FVector ClampSegmentDirection(const FVector& InDirection, const FVector& InParentDirection, const FMPAS_LimbSegmentData& InSegment);
+
 
 // DEBUGGING
 public:
@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MPAS_VoidRigElement.h"
+#include "MPAS_Limb.h"
+#include "MPAS_Piston.generated.h"
+
+
+// How the stages of a piston extend
+UENUM(BlueprintType)
+enum class EMPAS_PistonExtensionMode : uint8
+{
+	// All stages extend at the same time
+	Multi UMETA(DisplayName="Multi"),
+
+	// Stages extend one by one
+	Sequential UMETA(DisplayName="Sequential")
+};
+
+// Defines a single stage of UMPAS_Piston
+USTRUCT(BlueprintType)
+struct FMPAS_PistonStage
+{
+	GENERATED_USTRUCT_BODY()
+
+	// The length of the stage
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float Length = 0.f;
+
+	// Name of the bone, corresponding to this stage
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FName BoneName;
+};
+
+
+/**
+ * A telescopic multi-stage piston, a lightweight alternative to UMPAS_Limb with PistonMulti / PistonSequential algorithms
+ * Pistons don't solve themselves: the handler packs all pistons of the rig into a single batch and extends them in closed form after the rig is updated
+ * Stage bones face the target with their up axis kept towards piston's up vector and rolled by PistonRoll (there is no pole target based roll recalculation, unlike UMPAS_Limb)
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class MPAS_API UMPAS_Piston : public UMPAS_VoidRigElement
+{
+	GENERATED_BODY()
+
+public:
+	UMPAS_Piston();
+
+// PARAMETERS
+public:
+
+	// How the stages of the piston extend
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Piston")
+	EMPAS_PistonExtensionMode ExtensionMode;
+
+	// What should be used as a target of the piston
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Piston")
+	EMPAS_LimbTargetType TargetType;
+
+	// Stages of the piston, from the base to the tip (changes are applied when the handler packs the pistons)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Piston")
+	TArray<FMPAS_PistonStage> Stages;
+
+	// Additional roll (in degrees) of the stage bones around the piston's axis, used to match bone orientation of the mesh (changes are applied when the handler packs the pistons)
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Default|Piston")
+	float PistonRoll = 0.f;
+
+
+// DATA
+protected:
+
+	// Used as a target if TargetType is set to FirstChildComponent
+	USceneComponent* TargetComponent;
+
+	// ID of the vector stack, that is used as a target if TargetType is set to TargetVectorStack
+	int32 TargetStackID = -1;
+
+	// Index of the piston in the handler's piston batch ( -1 - the piston is not packed)
+	int32 PistonIndex = -1;
+
+
+// INTERFACE
+public:
+
+	// Returns the ID of the target vector stack, used if TargetType is set to TargetVectorStack
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="MPAS|Elements|Piston")
+	int32 GetTargetStackID() { return TargetStackID; }
+
+	// The point is space (World Space), which the piston is trying to reach
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="MPAS|Elements|Piston")
+	FVector GetPistonTarget();
+
+	// Sum of the lengths of all stages
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="MPAS|Elements|Piston")
+	float GetMaxExtent();
+
+	// Location of the given stage after the latest handler update (World Space)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="MPAS|Elements|Piston")
+	FVector GetStageLocation(int32 InStage);
+
+
+	// CALLED BY THE HANDLER : Sets the index of the piston in the handler's piston batch
+	void SetPistonIndex(int32 InPistonIndex) { PistonIndex = InPistonIndex; }
+
+
+// CALLED BY THE HANDLER
+public:
+
+	// CALLED BY THE HANDLER : Initializing Rig Element
+	virtual void InitRigElement(class UMPAS_Handler* InHandler) override;
+
+	// CALLED BY THE HANDLER : Contains the logic that links this element with other elements in the rig
+	virtual void LinkRigElement(class UMPAS_Handler* InHandler) override;
+
+	// CALLED BY THE HANDLER : Updating Rig Element every tick
+	virtual void UpdateRigElement(float DeltaTime) override;
+};
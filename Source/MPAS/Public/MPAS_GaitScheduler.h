@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MPAS_GaitScheduler.generated.h"
+
+
+// How the gait scheduler decides which legs are allowed to step
+UENUM(BlueprintType)
+enum class EMPAS_GaitMode : uint8
+{
+	// Leg groups take turns, the next group starts once the current one has finished it's steps
+	LegGroups UMETA(DisplayName="Leg Groups"),
+
+	// Every leg has a phase offset in a shared cycle, driven by speed, and is allowed to step during it's swing window
+	PhaseOscillator UMETA(DisplayName="Phase Oscillator")
+};
+
+// Distribution of leg phase offsets in PhaseOscillator gait mode (legs are ordered front to back on each side of their parent)
+UENUM(BlueprintType)
+enum class EMPAS_GaitPattern : uint8
+{
+	// A single leg swings at a time, the wave runs from the back to the front, one side after another
+	Wave UMETA(DisplayName="Wave"),
+
+	// Neighbouring legs and opposite legs alternate, half of the legs swing at a time
+	Tripod UMETA(DisplayName="Tripod"),
+
+	// A back to front wave on each side, the sides are half a cycle apart
+	Ripple UMETA(DisplayName="Ripple"),
+
+	// Phase offsets are set on each leg (UMPAS_Leg::GaitPhaseOffset)
+	Custom UMETA(DisplayName="Custom")
+};
+
+
+// Legs, that step together
+struct FMPAS_LegGroup
+{
+	// ID of the group (UMPAS_Leg::LegGroup)
+	int32 GroupID = 0;
+
+	// Legs, assigned to the group
+	TArray<class UMPAS_Leg*> Legs;
+};
+
+
+/**
+ * Coordinates steps of the legs of a single rig: leg groups take turns, the next group is activated once all the legs, that have started their steps, report them finished
+ * Owned by the handler, groups are stored sorted by ID (empty IDs are skipped), so advancing to the next group is O(1) and only the legs of that group are notified
+ * In PhaseOscillator mode groups are ignored: each leg is allowed to step during it's own window of a shared cycle (cost per leg doesn't depend on the number of groups)
+ */
+class MPAS_API FMPAS_GaitScheduler
+{
+public:
+
+	// CALLED BY LEGS : Adds the leg to the group with the given ID, returns the gait index of the leg
+	int32 RegisterLeg(class UMPAS_Leg* InLeg, int32 InLegGroup);
+
+	// Removes all groups and resets the state
+	void Reset();
+
+
+	// ID of the group, that is currently allowed to step (0 if there are no groups)
+	int32 GetCurrentLegGroup() const { return Groups.IsValidIndex(CurrentGroupIndex) ? Groups[CurrentGroupIndex].GroupID : 0; }
+
+	// Whether legs of the given group are currently allowed to step
+	bool IsLegGroupActive(int32 InLegGroup) const { return Groups.IsValidIndex(CurrentGroupIndex) && Groups[CurrentGroupIndex].GroupID == InLegGroup; }
+
+	// Whether the leg with the given gait index (in the given group) is currently allowed to step
+	bool CanLegStep(int32 InGaitIndex, int32 InLegGroup) const
+	{
+		if (Mode == EMPAS_GaitMode::PhaseOscillator)
+			return SwingOpen.IsValidIndex(InGaitIndex) && SwingOpen[InGaitIndex];
+
+		return IsLegGroupActive(InLegGroup);
+	}
+
+	// The number of legs, whose steps haven't reported finishing yet
+	int32 GetMovingLegsCount() const { return MovingLegsCount; }
+
+	// Sorted list of all leg groups
+	const TArray<FMPAS_LegGroup>& GetLegGroups() const { return Groups; }
+
+
+	// CALLED BY LEGS : A leg has started it's step
+	void OnStepStarted() { MovingLegsCount++; }
+
+	// CALLED BY LEGS : A leg has finished it's step (with respect to it's StepFinishTimeOffset), in LegGroups mode the next group is activated once no legs are moving
+	void OnStepFinished();
+
+	// Activates the next leg group and notifies it's legs (returns the ID of the new group)
+	int32 AdvanceLegGroup();
+
+
+	// Sets the gait mode (phase offsets must be built before switching to PhaseOscillator mode)
+	void SetMode(EMPAS_GaitMode InMode) { Mode = InMode; }
+
+	EMPAS_GaitMode GetMode() const { return Mode; }
+
+	// Current phase of the shared cycle [0, 1)
+	float GetPhase() const { return Phase; }
+
+	// Calculates phase offsets and swing fractions of all legs for the given pattern (InSwingFractionOverride <= 0 uses the pattern's default)
+	// Legs are ranked by their location in the space of InCoreTransform, so legs of different body segments are ordered along the whole rig
+	void BuildPhaseOffsets(EMPAS_GaitPattern InPattern, float InSwingFractionOverride, const FTransform& InCoreTransform);
+
+	// Advances the shared cycle by the given frequency and opens / closes swing windows of all legs in one pass, legs whose windows have opened are notified
+	void UpdatePhases(float DeltaTime, float InCycleFrequency);
+
+protected:
+
+	// Leg groups, sorted by ID
+	TArray<FMPAS_LegGroup> Groups;
+
+	// Index of the currently active group in Groups
+	int32 CurrentGroupIndex = 0;
+
+	// The number of legs, whose steps haven't reported finishing yet
+	int32 MovingLegsCount = 0;
+
+	// How legs are allowed to step
+	EMPAS_GaitMode Mode = EMPAS_GaitMode::LegGroups;
+
+
+	// Phase oscillator (per leg arrays are indexed by gait index)
+
+	// All registered legs
+	TArray<class UMPAS_Leg*> Legs;
+
+	// Per leg : offset of the leg's swing window in the cycle [0, 1)
+	TArray<float> PhaseOffsets;
+
+	// Per leg : portion of the cycle, during which the leg is allowed to step
+	TArray<float> SwingFractions;
+
+	// Per leg : whether the leg's swing window is currently open
+	TArray<bool> SwingOpen;
+
+	// Per leg : whether the leg's swing window has opened during the latest update
+	TArray<bool> SwingOpened;
+
+	// Phase of the shared cycle [0, 1)
+	float Phase = 0.f;
+};
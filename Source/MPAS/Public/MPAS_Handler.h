@@ -6,6 +6,8 @@
 #include "Components/ActorComponent.h"
 #include "IntentionDriving/MPAS_IntentionStateMachine.h"
 #include "STT_TimerController.h"
+#include "WorldCollision.h"
+#include "MPAS_GaitScheduler.h"
 #include "MPAS_Handler.generated.h"
 
 
@@ -88,6 +90,170 @@ struct FMPAS_PropogationSettings
 };
 
 
+// All pistons of the rig, packed for the closed-form batch evaluation (per-piston arrays are indexed by piston, per-stage arrays are flat)
+struct FMPAS_PistonBatch
+{
+	// Per piston : location of the origin (World Space)
+	TArray<FVector> Origins;
+
+	// Per piston : location of the target (World Space)
+	TArray<FVector> Targets;
+
+	// Per piston : up vector, stage bones keep their up axis towards it (World Space)
+	TArray<FVector> UpVectors;
+
+	// Per piston : additional roll of the stage bones around the piston's axis (in degrees)
+	TArray<float> Rolls;
+
+	// Per piston : whether the piston has submitted it's input during the current update
+	TArray<bool> Active;
+
+	// Per piston : whether stages extend one by one, instead of all at the same time
+	TArray<bool> Sequential;
+
+	// Per piston : sum of the lengths of all stages
+	TArray<float> MaxExtents;
+
+	// Per piston : index of the first stage in the flat stage arrays
+	TArray<int32> StageOffsets;
+
+	// Per piston : amount of stages
+	TArray<int32> StageCounts;
+
+	// Per stage : length of the stage
+	TArray<float> StageLengths;
+
+	// Per stage : bone, corresponding to the stage
+	TArray<FName> StageBones;
+
+	// Per stage : location of the stage after the latest evaluation (World Space)
+	TArray<FVector> StageLocations;
+};
+
+
+// A foot trace, requested by a leg during the current update (dispatched asynchronously at the end of the handler tick)
+struct FMPAS_FootTraceRequest
+{
+	// Start of the trace (World Space)
+	FVector Start = FVector::ZeroVector;
+
+	// End of the trace (World Space)
+	FVector End = FVector::ZeroVector;
+
+	// Whether the request was made during the current update and still has to be dispatched
+	bool Pending = false;
+};
+
+
+// A curve asset, sampled into a lookup table (samples are stored in the handler's flat sample array)
+struct FMPAS_BakedCurve
+{
+	// Index of the first sample
+	int32 Offset = 0;
+
+	// Amount of samples
+	int32 SampleNum = 0;
+
+	// Time range of the curve, covered by the samples
+	float MinTime = 0.f;
+	float MaxTime = 1.f;
+};
+
+// A step of a leg, that is currently being animated by the handler
+struct FMPAS_ActiveStep
+{
+	// The leg, that is making the step
+	class UMPAS_Leg* Leg = nullptr;
+
+	// Location of the foot at the start of the step (World Space)
+	FVector StartLocation = FVector::ZeroVector;
+
+	// Location of the foot at the end of the step (World Space)
+	FVector TargetLocation = FVector::ZeroVector;
+
+	// Direction, in which the foot is raised
+	FVector UpVector = FVector::UpVector;
+
+	// Peak height of the step (already scaled by the step distance)
+	float StepHeight = 0.f;
+
+	// Time since the start of the step (scaled by PlaybackSpeed)
+	float Time = 0.f;
+
+	// Duration of the step
+	float Duration = 1.f;
+
+	// Speed of the step animation
+	float PlaybackSpeed = 1.f;
+
+	// Time, at which the leg group assumes the step to be finished
+	float FinishNotifyTime = 1.f;
+
+	// Baked height and extent curves ( -1 - the default shape is used)
+	int32 HeightCurve = -1;
+	int32 ExtentCurve = -1;
+
+	// Whether the leg group was already notified about the step being finished
+	bool FinishNotified = false;
+};
+
+// State of a single cell of the terrain cache
+enum class EMPAS_TerrainCellState : uint8
+{
+	// The cell was never traced (or was invalidated)
+	Empty,
+
+	// Static ground was found in the cell
+	Ground,
+
+	// Nothing was found in the cell
+	NoGround,
+
+	// Movable geometry was found in the cell, it can't be cached
+	Dynamic
+};
+
+// Rolling heightfield around the rig: a toroidal grid of cells, each world cell is stored in the slot (CellX mod Resolution, CellY mod Resolution)
+struct FMPAS_TerrainCache
+{
+	// Amount of cells along each side of the grid
+	int32 Resolution = 0;
+
+	// Size of a single cell
+	float CellSize = 0.f;
+
+	// Per slot : world cell, that is currently stored in the slot
+	TArray<FIntPoint> Cells;
+
+	// Per slot : state of the stored cell
+	TArray<EMPAS_TerrainCellState> States;
+
+	// Per slot : height of the ground in the center of the cell (World Space)
+	TArray<float> Heights;
+
+	// Per slot : normal of the ground in the center of the cell
+	TArray<FVector> Normals;
+
+	// Per slot : world time of the latest trace result
+	TArray<float> Timestamps;
+
+	// Per slot : whether a trace was dispatched for the slot and it's result hasn't arrived yet
+	TArray<bool> Pending;
+
+	// Index of the next window cell to be checked for refreshing
+	int32 Cursor = 0;
+
+	bool IsValid() const { return Resolution > 0 && CellSize > 0.f; }
+
+	// World cell, containing the given location
+	FIntPoint GetCell(const FVector& InLocation) const { return FIntPoint(FMath::FloorToInt(InLocation.X / CellSize), FMath::FloorToInt(InLocation.Y / CellSize)); }
+
+	// Slot, where the given world cell is stored
+	int32 GetSlot(const FIntPoint& InCell) const { return ((InCell.X % Resolution + Resolution) % Resolution) + ((InCell.Y % Resolution + Resolution) % Resolution) * Resolution; }
+};
+
+
+
 // --------------------------------------------------
 // HANDLER
 
@@ -346,6 +512,296 @@ public:
 
 
 
+// IK ITERATION BUDGET
+
+protected:
+
+	// List of all limbs in the rig
+	TArray<class UMPAS_Limb*> Limbs;
+
+	// Limbs that compete for the budget on the current update, paired with their priorities (kept between updates to avoid reallocation)
+	TArray<TPair<float, class UMPAS_Limb*>> IKBudgetCandidates;
+
+	// Distributes IK_IterationBudget between limbs by their priority, limbs that didn't get any iterations keep their last pose
+	void AllocateIKBudget();
+
+	// Solves the limbs, that have gathered changed inputs during the rig update
+	void DispatchLimbSolves();
+
+public:
+
+	// Maximum total amount of IK iterations all limbs of the rig can use during a single update, 0 means that the amount is unlimited
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|IKBudget")
+	int32 IK_IterationBudget = 0;
+
+
+
+// PISTONS
+
+protected:
+
+	// List of all pistons in the rig, in the order they are packed into the batch
+	TArray<class UMPAS_Piston*> Pistons;
+
+	// All pistons of the rig, packed for the closed-form batch evaluation
+	FMPAS_PistonBatch PistonBatch;
+
+	// Packs all pistons into the batch, assigning their piston indices
+	void BuildPistonBatch();
+
+	// Extends all pistons, that have submitted their input during this update, and writes their bones
+	void SolvePistons();
+
+public:
+
+	// CALLED BY PISTONS : Submits piston's input for the current update
+	void SetPistonInput(int32 InPistonIndex, const FVector& InOrigin, const FVector& InTarget, const FVector& InUpVector);
+
+	// Returns packed data of all pistons in the rig (stage locations are updated after the rig update)
+	const FMPAS_PistonBatch& GetPistonBatch() { return PistonBatch; }
+
+	// Repacks all pistons of the rig (call after modifying piston stages at runtime)
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Handler|Pistons")
+	void RebuildPistonBatch() { BuildPistonBatch(); }
+
+
+
+// FOOT TRACES
+
+protected:
+
+	// List of all legs in the rig, index of the leg in this list is it's foot trace index
+	TArray<class UMPAS_Leg*> FootTraceLegs;
+
+	// Foot trace requests of all legs, FootTraceSlotNum slots per leg (indexed by FootTraceIndex * FootTraceSlotNum + Slot)
+	TArray<FMPAS_FootTraceRequest> FootTraceRequests;
+
+	// Receives the results of all foot traces of the rig
+	FTraceDelegate FootTraceDelegate;
+
+	// Starts asynchronous traces for all foot trace requests made during this update (results are delivered to the legs next frame)
+	void DispatchFootTraces();
+
+	// Called when an asynchronous foot trace is completed, delivers the result to the leg, that has requested it
+	void OnFootTraceCompleted(const FTraceHandle& InTraceHandle, FTraceDatum& InTraceDatum);
+
+public:
+
+	// Amount of independent foot trace requests, that a single leg can make during one update
+	static constexpr int32 FootTraceSlotNum = 2;
+
+	// CALLED BY LEGS : Requests an asynchronous foot trace in the given slot (a repeated request in the same slot overrides the previous one)
+	void RequestFootTrace(int32 InFootTraceIndex, int32 InSlot, const FVector& InStart, const FVector& InEnd);
+
+
+
+
+// GAIT
+
+protected:
+
+	// Coordinates steps of all legs of the rig
+	FMPAS_GaitScheduler GaitScheduler;
+
+	// Location of the core on the previous update, used to measure rig's speed
+	FVector GaitPreviousCoreLocation = FVector::ZeroVector;
+
+	// Smoothed horizontal speed of the core
+	float GaitSpeed = 0.f;
+
+	// Calculates phase offsets of the legs after the rig is linked
+	void BuildGait();
+
+	// Advances the gait cycle by the speed of the core (PhaseOscillator mode)
+	void UpdateGait(float DeltaTime);
+
+public:
+
+	// Returns the gait scheduler of the rig (legs register in it during their initialization)
+	FMPAS_GaitScheduler& GetGaitScheduler() { return GaitScheduler; }
+
+	// How legs are allowed to step: taking turns by leg groups, or by phase offsets in a shared cycle
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|Gait")
+	EMPAS_GaitMode GaitMode = EMPAS_GaitMode::LegGroups;
+
+	// Distribution of leg phase offsets in PhaseOscillator mode (applied on rebuild)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|Gait")
+	EMPAS_GaitPattern GaitPattern = EMPAS_GaitPattern::Tripod;
+
+	// Portion of the cycle, during which a leg is allowed to step, 0 uses the default of the pattern (applied on rebuild)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|Gait", meta=(ClampMin=0, ClampMax=1))
+	float Gait_SwingFractionOverride = 0.f;
+
+	// Distance the core travels during one gait cycle, the cycle frequency is speed / stride length
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|Gait", meta=(ClampMin=1))
+	float Gait_StrideLength = 200.f;
+
+	// Cycle frequency when the rig stands still (legs still need to step while turning in place)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|Gait", meta=(ClampMin=0))
+	float Gait_MinCycleFrequency = 0.5f;
+
+	// Upper limit of the cycle frequency
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|Gait", meta=(ClampMin=0))
+	float Gait_MaxCycleFrequency = 3.f;
+
+	// Recalculates phase offsets of all legs (call after changing GaitPattern or Gait_SwingFractionOverride at runtime)
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Handler|Gait")
+	void RebuildGait() { BuildGait(); }
+
+	// Current phase of the shared gait cycle [0, 1) (PhaseOscillator mode)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Handler|Gait")
+	float GetGaitPhase() { return GaitScheduler.GetPhase(); }
+
+	// CALLED BY LEGS : A leg has started it's step
+	void NotifyLegStepStarted() { GaitScheduler.OnStepStarted(); }
+
+	// CALLED BY LEGS : A leg has finished it's step, activates the next leg group once no legs are moving
+	void NotifyLegStepFinished();
+
+	// ID of the leg group, that is currently allowed to step (also mirrored into "CurrentLegGroup" int parameter for Blueprints)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Handler|Gait")
+	int32 GetCurrentLegGroup() { return GaitScheduler.GetCurrentLegGroup(); }
+
+	// The number of legs, whose steps haven't finished yet
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Handler|Gait")
+	int32 GetMovingLegsCount() { return GaitScheduler.GetMovingLegsCount(); }
+
+
+// STEP ANIMATION
+
+protected:
+
+	// Steps of all legs, that are currently moving, evaluated in one loop per update
+	TArray<FMPAS_ActiveStep> ActiveSteps;
+
+	// Legs, whose steps have finished during the current update (kept between updates to avoid reallocation)
+	TArray<class UMPAS_Leg*> FinishedStepLegs;
+
+	// The number of legs, that have reached their finish notify time during the current update
+	int32 FinishNotifiedStepNum = 0;
+
+	// All baked curves
+	TArray<FMPAS_BakedCurve> BakedCurves;
+
+	// Samples of all baked curves
+	TArray<float> BakedCurveSamples;
+
+	// Curve assets, that were already baked, and their indices in BakedCurves
+	TMap<TObjectKey<class UCurveFloat>, int32> BakedCurveIndices;
+
+	// Advances all active steps, moves the feet, and notifies legs and the gait scheduler about finished steps
+	void UpdateStepAnimations(float DeltaTime);
+
+public:
+
+	// Amount of samples in baked step animation curves
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|StepAnimation", meta=(ClampMin=2, ClampMax=1024))
+	int32 StepAnimation_CurveSamples = 64;
+
+	// CALLED BY LEGS : Samples the curve into a lookup table (once per curve asset), returns the index of the baked curve ( -1 if the curve is nullptr)
+	int32 BakeCurve(class UCurveFloat* InCurve);
+
+	// Evaluates a baked curve at the given time (clamped to the time range of the curve)
+	float SampleBakedCurve(int32 InCurveIndex, float InTime) const;
+
+	// CALLED BY LEGS : Starts animating a step, returns the index of the step
+	int32 StartStep(const FMPAS_ActiveStep& InStep);
+
+	// CALLED BY LEGS : Changes the target location and height of an active step (when a more precise foot location is found)
+	void RetargetStep(int32 InStepIndex, const FVector& InTargetLocation, float InStepHeight);
+
+
+// TERRAIN CACHE
+
+protected:
+
+	// Heightfield around the core, sampled by foot placement instead of casting traces
+	FMPAS_TerrainCache TerrainCache;
+
+	// Receives the results of terrain cache traces
+	FTraceDelegate TerrainTraceDelegate;
+
+	// Allocates the terrain cache, using current parameters (all cells are empty)
+	void BuildTerrainCache();
+
+	// Starts asynchronous traces for up to TerrainCache_TracesPerUpdate missing or outdated cells around the core
+	void RefreshTerrainCache();
+
+	// Called when an asynchronous terrain cache trace is completed
+	void OnTerrainTraceCompleted(const FTraceHandle& InTraceHandle, FTraceDatum& InTraceDatum);
+
+	// Writes the result of a ground query into the given slot of the terrain cache (InHit is nullptr if nothing was found)
+	void WriteTerrainCell(int32 InSlot, const FHitResult* InHit);
+
+public:
+
+	// Whether foot placement samples a rolling heightfield around the core instead of casting traces
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|TerrainCache")
+	bool EnableTerrainCache = false;
+
+	// Amount of cells along each side of the cache, it covers TerrainCache_Resolution * TerrainCache_CellSize around the core (applied on rebuild)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|TerrainCache", meta=(ClampMin=2, ClampMax=128))
+	int32 TerrainCache_Resolution = 16;
+
+	// Size of a single cell of the cache (applied on rebuild)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|TerrainCache", meta=(ClampMin=1))
+	float TerrainCache_CellSize = 50.f;
+
+	// Maximum amount of traces, that refresh the cache during a single update
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|TerrainCache", meta=(ClampMin=1))
+	int32 TerrainCache_TracesPerUpdate = 16;
+
+	// Cache traces start this high above the core and end this low below it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|TerrainCache")
+	float TerrainCache_TraceHalfHeight = 1000.f;
+
+	// Time after which a cell is considered outdated: it is refreshed and can't be sampled until the new result arrives
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|TerrainCache")
+	float TerrainCache_MaxAge = 2.f;
+
+	// Maximal height difference between neighbouring cells, that are sampled together (larger differences are edges, that are traced directly)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|TerrainCache")
+	float TerrainCache_MaxHeightDifference = 30.f;
+
+	// Collision channel of the cache traces
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Default|TerrainCache")
+	TEnumAsByte<ECollisionChannel> TerrainCache_Channel = ECC_Visibility;
+
+
+	/*
+	 * Samples the terrain cache at the given location (bilinear between the 4 nearest cells)
+	 * Returns false if any of these cells is missing, outdated, dynamic, has no ground or lies across an edge - the caller should trace instead
+	 */
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Handler|TerrainCache")
+	bool SampleTerrainCache(const FVector& InLocation, float& OutHeight, FVector& OutNormal);
+
+	// Empties cells within the radius around the location (call when geometry there changes)
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Handler|TerrainCache")
+	void InvalidateTerrainCache(const FVector& InLocation, float InRadius);
+
+	// Reallocates the terrain cache with current parameters, all cells are traced again
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Handler|TerrainCache")
+	void RebuildTerrainCache() { BuildTerrainCache(); }
+
+
+
+// GROUND QUERIES
+
+public:
+
+	// How ground is found for foot placement (legs, crawlers, intention drivers), physics traces are used if nothing is selected
+	UPROPERTY(EditAnywhere, Instanced, BlueprintReadWrite, Category = "Default|GroundQuery")
+	class UMPAS_GroundQueryBackend* GroundQueryBackend = nullptr;
+
+	// Looks for the ground on the segment from InStart to InEnd, using selected ground query backend
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Handler|GroundQuery")
+	bool QueryGround(const FVector& InStart, const FVector& InEnd, FHitResult& OutHit, ECollisionChannel InChannel = ECC_Visibility);
+
+	// Whether ground queries are physics traces, that can be performed asynchronously (foot traces and terrain cache are queried synchronously otherwise)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Handler|GroundQuery")
+	bool UsesAsyncGroundQueries();
+
+
 // INPUT
 
 protected:
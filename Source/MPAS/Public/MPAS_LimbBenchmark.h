@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "Default/RigElements/MPAS_Limb.h"
+#include "MPAS_LimbBenchmark.generated.h"
+
+
+// Kind of targets, generated for a benchmark run
+UENUM(BlueprintType)
+enum class EMPAS_LimbBenchmarkTargetSet : uint8
+{
+	// Targets within limb's max extent, segments have no limits
+	Reachable UMETA(DisplayName="Reachable"),
+
+	// Targets beyond limb's max extent (not clamped like in UMPAS_Limb::GetLimbTarget, so solvers run out of iterations)
+	Unreachable UMETA(DisplayName="Unreachable"),
+
+	// Targets within limb's max extent, segments have swing-twist limits
+	Limited UMETA(DisplayName="Limited")
+};
+
+// Measurements of a single algorithm on a single target set
+USTRUCT(BlueprintType)
+struct FMPAS_LimbBenchmarkResult
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	EMPAS_LimbSolvingAlgorithm Algorithm = EMPAS_LimbSolvingAlgorithm::FABRIK_IK;
+
+	UPROPERTY(BlueprintReadOnly)
+	EMPAS_LimbBenchmarkTargetSet TargetSet = EMPAS_LimbBenchmarkTargetSet::Reachable;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 SegmentCount = 0;
+
+	// Roll recalculation, applied after every solve (a part of the measured time)
+	UPROPERTY(BlueprintReadOnly)
+	EMPAS_LimbRollRecalculationMode RollRecalculationMode = EMPAS_LimbRollRecalculationMode::SolutionPlane;
+
+	// Average time of a single solve (including roll recalculation), in nanoseconds
+	UPROPERTY(BlueprintReadOnly)
+	float AverageSolveTimeNs = 0.f;
+
+	// Average amount of iterations used by a solve (0 for non-iterative algorithms)
+	UPROPERTY(BlueprintReadOnly)
+	float AverageIterations = 0.f;
+
+	// Average distance between the tip and the target after a solve
+	UPROPERTY(BlueprintReadOnly)
+	float AverageError = 0.f;
+
+	// Largest distance between the tip and the target after a solve
+	UPROPERTY(BlueprintReadOnly)
+	float MaxError = 0.f;
+
+	// Portion of solves, that have converged within the tollerance
+	UPROPERTY(BlueprintReadOnly)
+	float ConvergedRatio = 0.f;
+
+	// Largest angle (in degrees) by which a segment has left the swing cone around it's parent segment, only measured on the Limited target set (the first segment is not limited)
+	UPROPERTY(BlueprintReadOnly)
+	float MaxSwingLimitViolation = 0.f;
+
+	// Largest angle (in degrees) by which a segment's twist relative to it's parent segment has left the twist limits, only measured on the Limited target set (twist comes from roll recalculation)
+	UPROPERTY(BlueprintReadOnly)
+	float MaxTwistLimitViolation = 0.f;
+};
+
+
+/**
+ * Reproducible benchmark of limb solvers: every solving algorithm is run over generated chains and target sets with a fixed seed
+ * Can be run headless with console command "MPAS.BenchmarkLimbSolvers [TargetsPerSet] [MaxIterations] [Tollerance] [Seed]", e.g. -nullrhi -ExecCmds="MPAS.BenchmarkLimbSolvers 256, Quit"
+ * Accuracy and convergence thresholds are gated by automation tests "MPAS.Limb.Solvers" (benchmarking is compiled out of shipping builds, functions return empty results)
+ */
+UCLASS()
+class MPAS_API UMPAS_LimbBenchmarkLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+
+	// Runs every solving algorithm over every target set for chains of 2, 3, 4, 6, 16 and 64 segments with every roll recalculation mode (cold starts, same seed - same targets)
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Debug|Benchmark")
+	static TArray<FMPAS_LimbBenchmarkResult> BenchmarkLimbSolvers(int32 InTargetsPerSet = 256, int32 InMaxIterations = 32, float InTollerance = 1.f, int32 InSeed = 0);
+
+	// Runs a single algorithm over a single generated target set, recalculating roll with the given mode (roll mode doesn't affect the generated targets)
+	UFUNCTION(BlueprintCallable, Category = "MPAS|Debug|Benchmark")
+	static FMPAS_LimbBenchmarkResult BenchmarkLimbSolver(EMPAS_LimbSolvingAlgorithm InAlgorithm, EMPAS_LimbBenchmarkTargetSet InTargetSet, int32 InSegmentCount, int32 InTargetsPerSet = 256, int32 InMaxIterations = 32, float InTollerance = 1.f, int32 InSeed = 0, EMPAS_LimbRollRecalculationMode InRollRecalculationMode = EMPAS_LimbRollRecalculationMode::SolutionPlane);
+
+	// Largest swing and twist limit violations (in degrees) of a solved state, relative to the parent segments
+	static void MeasureLimitViolations(const TArray<FMPAS_LimbSegmentState>& InState, const TArray<FMPAS_LimbSegmentData>& InSegments, float& OutSwingViolation, float& OutTwistViolation);
+
+	// Formats benchmark results as a table, one line per result
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "MPAS|Debug|Benchmark")
+	static FString FormatBenchmarkResults(const TArray<FMPAS_LimbBenchmarkResult>& InResults);
+};
@@ -471,6 +471,9 @@ public:
 	// CALLED BY THE HANDLER : Updating Rig Element every tick
 	virtual void UpdateRigElement(float DeltaTime);
 
+	// CALLED BY THE HANDLER : Called every tick after all rig elements were updated (desired transforms of all elements are final)
+	virtual void PostUpdateRigElement(float DeltaTime);
+
 	// CALLED BY THE HANDLER : Synchronizes Rig Element to the most recently fetched bone transforms
 	virtual void SyncToFetchedBoneTransforms(float DeltaTime);
 
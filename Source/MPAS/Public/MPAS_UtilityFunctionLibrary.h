@@ -19,4 +19,8 @@ class MPAS_API UMPAS_UtilityFunctionLibrary : public UBlueprintFunctionLibrary
 	// A wrapper around LineTraceByChannel that can be called from direct objects descendants in Blueprints
 	UFUNCTION(BlueprintCallable, Category = "RawObjectCallable")
 	static bool RawObjectLineTraceByChannel(AActor* ContextActor, struct FHitResult& OutHit, const FVector& Start, const FVector& End, ECollisionChannel TraceChannel);
+
+	// Looks for the ground, using the ground query backend of the context actor's MPAS handler (a line trace, if the actor has no handler)
+	UFUNCTION(BlueprintCallable, Category = "RawObjectCallable")
+	static bool RawObjectGroundQuery(AActor* ContextActor, struct FHitResult& OutHit, const FVector& Start, const FVector& End, ECollisionChannel TraceChannel);
 };